@@ -19,6 +19,7 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
@@ -31,6 +32,8 @@ struct {
   // Sorted by how recently the buffer was used.
   // head.next is most recent, head.prev is least.
   struct buf head;
+
+  uint64 nwrite;  // blocks written to disk
 } bcache;
 
 void
@@ -93,11 +96,14 @@ struct buf*
 bread(uint dev, uint blockno)
 {
   struct buf *b;
+  struct proc *p = myproc();
 
   b = bget(dev, blockno);
   if(!b->valid) {
     virtio_disk_rw(b, 0);
     b->valid = 1;
+    if(p)
+      __sync_fetch_and_add(&p->leader->ru.inblock, 1);
   }
   return b;
 }
@@ -109,6 +115,14 @@ bwrite(struct buf *b)
   if(!holdingsleep(&b->lock))
     panic("bwrite");
   virtio_disk_rw(b, 1);
+  __sync_fetch_and_add(&bcache.nwrite, 1);
+}
+
+// The number of blocks written to disk since boot.
+uint64
+bnwrite(void)
+{
+  return bcache.nwrite;
 }
 
 // Release a locked buffer.
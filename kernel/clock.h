@@ -0,0 +1,28 @@
+// The clock page: a page the kernel maps read-only at CLOCKPAGE
+// in each process, so that user code can tell the time, and see
+// some of its own counters, without a system call.
+//
+// User mode may read the time CSR (rdtime), which counts hz
+// cycles per second since boot. A tick, the unit of uptime()
+// and sleep(), is tickcycles of them. The counters belong to
+// the whole process, all its threads; the kernel updates them
+// as it goes, and the process may read them at any time.
+// getrusage() reports nfault, nvcsw and nivcsw from here.
+
+struct clockpage {
+  uint64 hz;              // time CSR cycles per second
+  uint64 tickcycles;      // cycles per tick
+  uint64 nsmult;          // ns = (cycles * nsmult) >> nsshift,
+  uint64 nsshift;         //   for cycles < hz
+  uint64 nsyscall;        // system calls made
+  uint64 nfault;          // page faults taken on mmap()ed pages
+  uint64 nvcsw;           // switches while waiting for something
+  uint64 nivcsw;          // switches because a time slice ran out
+};
+
+#define CLOCK_MONOTONIC 1 // time since boot; the only clock
+
+struct timespec {
+  uint64 sec;
+  uint64 nsec;
+};
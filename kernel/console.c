@@ -21,6 +21,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "poll.h"
 
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
@@ -50,6 +51,8 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+
+  struct pollhead poll;  // poll()s waiting for a line
 } cons;
 
 //
@@ -170,6 +173,7 @@ consoleintr(int c)
         // has arrived.
         cons.w = cons.e;
         wakeup(&cons.r);
+        pollwake(&cons.poll, POLLIN);
       }
     }
     break;
@@ -178,10 +182,28 @@ consoleintr(int c)
   release(&cons.lock);
 }
 
+//
+// poll() on the console: readable once a whole line (or
+// end-of-file) has arrived; always writable.
+//
+int
+consolepoll(struct polltable *pt)
+{
+  int r = POLLOUT;
+
+  acquire(&cons.lock);
+  pollwait(&cons.poll, pt, POLLIN);
+  if(cons.r != cons.w)
+    r |= POLLIN;
+  release(&cons.lock);
+  return r;
+}
+
 void
 consoleinit(void)
 {
   initlock(&cons.lock, "cons");
+  initpollhead(&cons.poll);
 
   uartinit();
 
@@ -189,4 +211,5 @@ consoleinit(void)
   // to consoleread and consolewrite.
   devsw[CONSOLE].read = consoleread;
   devsw[CONSOLE].write = consolewrite;
+  devsw[CONSOLE].poll = consolepoll;
 }
@@ -0,0 +1,140 @@
+// Directory entry cache, for namex()'s lock-free fast path.
+//
+// Each entry remembers that directory (dev, dinum) held name
+// -> inum when the directory's sequence number ip->dseq had a
+// given value. Every change to a directory's content gives it
+// a new dseq (see writei()), as does reading it into the inode
+// cache, so an entry is only believed while the directory is
+// unchanged since it was made. Changes don't need to find and
+// remove stale entries; they just stop matching.
+//
+// Lookups read the table under RCU and take no lock. An entry
+// never changes once it's in the table: dcacheput() takes
+// dcache.lock, fills in a free entry, and swaps it into its
+// slot, and the old one goes back on the free list through
+// call_rcu() once no lookup can still be reading it.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "stat.h"
+#include "fs.h"
+#include "file.h"
+#include "rcu.h"
+
+#define NDCACHE 128
+#define NDENTRY (2*NDCACHE)   // room for replaced entries to wait
+
+struct dentry {
+  struct rcuhead rcu;
+  struct dentry *next;  // on the free list
+  uint dev;
+  uint dinum;         // directory's inode number
+  uint dseq;          // directory's dseq when the entry was made
+  uint inum;          // inode that name refers to
+  char name[DIRSIZ];
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry *slot[NDCACHE];  // under RCU
+  struct dentry *free;
+  struct dentry e[NDENTRY];
+} dcache;
+
+void
+dcacheinit(void)
+{
+  int i;
+
+  initlock(&dcache.lock, "dcache");
+  for(i = 0; i < NDENTRY; i++){
+    dcache.e[i].next = dcache.free;
+    dcache.free = &dcache.e[i];
+  }
+}
+
+// Put a replaced entry back on the free list, once no
+// lookup can be reading it.
+static void
+dentfree(struct rcuhead *h)
+{
+  struct dentry *e = (struct dentry*)h;
+
+  acquire(&dcache.lock);
+  e->next = dcache.free;
+  dcache.free = e;
+  release(&dcache.lock);
+}
+
+static struct dentry**
+dcachehash(uint dev, uint dinum, char *name)
+{
+  uint h = dev * 31 + dinum;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return &dcache.slot[((h * 0x9E3779B9U) >> 16) % NDCACHE];
+}
+
+// Look up name in directory dp without locking dp. Returns
+// the inode number it had when dp's dseq was *seq, or 0 if
+// there is no such entry cached. dp must be referenced; its
+// dseq may change at any time, so the caller must check it
+// again after using the result.
+uint
+dcacheget(struct inode *dp, char *name, uint *seq)
+{
+  struct dentry **slot, *e;
+  uint dseq, inum = 0;
+
+  // dp's type and dseq are only meaningful once it's valid.
+  if(__atomic_load_n(&dp->valid, __ATOMIC_ACQUIRE) == 0 || dp->type != T_DIR)
+    return 0;
+  dseq = __atomic_load_n(&dp->dseq, __ATOMIC_ACQUIRE);
+
+  slot = dcachehash(dp->dev, dp->inum, name);
+  rcu_read_lock();
+  e = rcu_dereference(*slot);
+  if(e && e->dev == dp->dev && e->dinum == dp->inum && e->dseq == dseq &&
+     strncmp(e->name, name, DIRSIZ) == 0)
+    inum = e->inum;
+  rcu_read_unlock();
+
+  if(inum)
+    *seq = dseq;
+  return inum;
+}
+
+// Remember that name in dp refers to inum as of dp's dseq seq,
+// which the caller read while holding dp's lock.
+void
+dcacheput(struct inode *dp, char *name, uint inum, uint seq)
+{
+  struct dentry **slot = dcachehash(dp->dev, dp->inum, name);
+  struct dentry *e, *old;
+
+  acquire(&dcache.lock);
+  // all free entries may be waiting out a grace period;
+  // it's only a cache, so do without.
+  if((e = dcache.free) == 0){
+    release(&dcache.lock);
+    return;
+  }
+  dcache.free = e->next;
+  e->dev = dp->dev;
+  e->dinum = dp->inum;
+  e->dseq = seq;
+  e->inum = inum;
+  strncpy(e->name, name, DIRSIZ);
+  old = *slot;
+  rcu_assign_pointer(*slot, e);
+  release(&dcache.lock);
+
+  if(old)
+    call_rcu(&old->rcu, dentfree);
+}
@@ -1,13 +1,22 @@
 struct buf;
+struct clockpage;
 struct context;
+struct cpu;
 struct file;
 struct inode;
+struct iovec;
 struct pipe;
+struct pollfd;
+struct pollhead;
+struct polltable;
 struct proc;
+struct rcuhead;
+struct sqe;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct vma;
 
 // bio.c
 void            binit(void);
@@ -16,6 +25,7 @@ void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+uint64          bnwrite(void);
 
 // console.c
 void            consoleinit(void);
@@ -31,8 +41,17 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
+int             filepread(struct file*, uint64, int n, uint off);
+int             filereadv(struct file*, struct iovec*, int);
 int             filestat(struct file*, uint64 addr);
+int             filefcntl(struct file*, int, int);
+int             filepoll(struct file*, int, struct polltable*);
+int             filesync(struct file*, int);
 int             filewrite(struct file*, uint64, int n);
+int             filepwrite(struct file*, uint64, int n, uint off);
+int             filewritev(struct file*, struct iovec*, int);
+int             filesend(struct file*, struct file*, int);
+int             filesplice(struct file*, struct file*, int);
 
 // fs.c
 void            fsinit(int);
@@ -42,6 +61,7 @@ struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
@@ -50,6 +70,7 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+int             sendi(struct inode*, uint, uint, int (*)(void*, char*, int), void*);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
@@ -59,22 +80,61 @@ void            ramdiskinit(void);
 void            ramdiskintr(void);
 void            ramdiskrw(struct buf*);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint64, int);
+int             futexwake(uint64, int);
+
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kdup(void *);
+int             krefs(void *);
+void*           kallocmega(void);
+void            kfreemega(void *);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+uint64          log_tid(void);
+void            log_force(uint64);
+int             commitdelay(int);
+uint64          log_ncommit(void);
+
+// dcache.c
+void            dcacheinit(void);
+uint            dcacheget(struct inode*, char*, uint*);
+void            dcacheput(struct inode*, char*, uint, uint);
+
+// pcache.c
+void            pcinit(void);
+char*           pcget(struct inode*, uint, int);
+char*           pcpeek(struct inode*, uint);
+void            pcwrite(struct inode*, uint, char*, uint);
+void            pcinval(struct inode*);
+int             pcreclaim(void);
+
+// poll.c
+void            initpollhead(struct pollhead*);
+void            pollwait(struct pollhead*, struct polltable*, int);
+void            pollwake(struct pollhead*, int);
+int             poll(struct pollfd*, struct file**, int, int);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, uint64, int, int);
+int             pipewrite(struct pipe*, uint64, int, int);
+int             pipepoll(struct pipe*, int, struct polltable*);
+int             pipeput(struct pipe*, char*, int);
+int             pipewaitroom(struct pipe*);
+int             pipeaddpage(struct pipe*, char*, uint, uint);
+int             pipetake(struct pipe*, int, char**, uint*, int);
+int             pipesize(struct pipe*);
+int             pipesetsize(struct pipe*, int);
 
 // printf.c
 void            printf(char*, ...);
@@ -86,6 +146,7 @@ int             cpuid(void);
 void            exit(int);
 int             fork(void);
 int             growproc(int);
+void            tlbshootdown(struct proc*);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
@@ -100,8 +161,20 @@ void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
+int             wait2(uint64, uint64);
+int             getrusage(int, uint64);
+void            chargetime(struct proc*, int);
 void            wakeup(void*);
+void            wakeupone(void*);
+int             wakeupn(void*, int);
 void            yield(void);
+void            schedtick(void);
+void            schedboost(void);
+int             setpriority(int, int);
+int             clone(uint64, uint64, uint64, uint64, uint64);
+int             join(uint64);
+void            killthreads(struct proc*);
+int             kthread(struct proc*, void (*)(void), char*);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -113,12 +186,34 @@ void            swtch(struct context*, struct context*);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            freelock(struct spinlock*);
+int             lockstats(uint64, int);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// rcu.c
+void            rcuinit(void);
+void            rcu_read_lock(void);
+void            rcu_read_unlock(void);
+void            rcu_qs(void);
+void            rcu_idle(int);
+int             rcu_busy(void);
+void            call_rcu(struct rcuhead*, void (*)(struct rcuhead*));
+void            synchronize_rcu(void);
+#ifdef RCUTEST
+void            rcutest(void);
+#endif
+
+// ring.c
+uint64          ringsetup(int);
+int             ringenter(int, int);
+void            ringstop(struct proc*);
+void            ringfree(struct proc*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
@@ -132,6 +227,9 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// sysfile.c
+int             ringop(struct sqe*);
+
 // syscall.c
 int             argint(int, int*);
 int             argstr(int, char*, int);
@@ -141,10 +239,8 @@ int             fetchaddr(uint64, uint64*);
 void            syscall();
 
 // trap.c
-extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
-extern struct spinlock tickslock;
 void            usertrapret(void);
 
 // uart.c
@@ -154,20 +250,59 @@ void            uartputc(int);
 void            uartputc_sync(int);
 int             uartgetc(void);
 
+// timer.c
+void            tminit(void);
+uint            uptime(void);
+void            clockpageinit(struct clockpage*);
+void            timerbusy(int);
+void            timeradd(struct cpu*, uint64);
+void            timerdel(struct cpu*);
+int             timersleep(uint64);
+int             timerintr(void);
+
+// prof.c
+extern uint64   profinterval;
+void            profinit(void);
+void            profsample(void);
+int             profstart(int);
+uint64          profstop(void);
+int             profread(uint64, int);
+
+// vma.c
+struct vma*     vmalookup(struct proc*, uint64);
+int             vmafault(pagetable_t, uint64);
+void            vmaprefault(uint64, uint64);
+struct vma*     vmaoverlap(struct proc*, uint64, uint64);
+int             vmadup(struct proc*, struct proc*);
+void            vmafree(pagetable_t, struct vma*);
+uint64          vmammap(uint64, int, int, struct file*, uint);
+int             vmaunmap(uint64, uint64);
+
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
+pte_t*          walk(pagetable_t, uint64, int);
+pte_t*          walklevel(pagetable_t, uint64, int, int);
+pte_t*          walkleaf(pagetable_t, uint64, uint64*);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
+int             mappages_level(pagetable_t, uint64, uint64, uint64, int, int);
+#ifdef MEMBENCH
+void            kvmbench(void);
+#endif
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopy_range(pagetable_t, pagetable_t, uint64, uint64, int);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+int             uvmsplit(pagetable_t, uint64);
+void            uvmrevoke(pagetable_t, uint64, uint64);
 uint64          walkaddr(pagetable_t, uint64);
+uint64          uvmaddr(pagetable_t, uint64, int);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
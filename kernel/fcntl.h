@@ -3,4 +3,23 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
-#define O_NOFOLLOW   0x800
\ No newline at end of file
+#define O_NOFOLLOW   0x800
+#define O_NONBLOCK   0x1000
+
+// fcntl() commands
+#define F_GETPIPE_SZ 1  // a pipe's capacity in bytes
+#define F_SETPIPE_SZ 2  // set it, rounded up to whole pages
+#define F_GETFL      3  // O_RDONLY etc., and O_NONBLOCK
+#define F_SETFL      4  // set O_NONBLOCK; other flags are ignored
+
+// mmap() protection
+#define PROT_NONE  0x0
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC  0x4
+
+// mmap() flags
+#define MAP_SHARED    0x01
+#define MAP_PRIVATE   0x02
+#define MAP_ANONYMOUS 0x20
+#define MAP_HUGE      0x40  // back with 2MB megapages
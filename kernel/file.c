@@ -11,47 +11,166 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
+#include "fcntl.h"
 #include "proc.h"
+#include "uio.h"
+#include "poll.h"
 
 struct devsw devsw[NDEV];
+// Free struct files are kept on per-cpu lists, cpus[].ffree,
+// so that filealloc() and the last fileclose() of a file take
+// no shared lock. A cpu whose list runs dry takes FBATCH files
+// from the shared pool, which carves a new page into files if
+// it has none; one whose list grows past 2*FBATCH gives FBATCH
+// back. The pool keeps each page's free files on the page's
+// own list, and gives a page back to kfree() once all of its
+// files are free again.
+#define FBATCH 16
+
+// the head of each page of files.
+struct fpage {
+  struct fpage *next;  // on fpool.pages while it has free files
+  struct file *free;   // its files in the pool
+  int nfree;
+};
+
+#define FPERPAGE ((PGSIZE - sizeof(struct fpage)) / sizeof(struct file))
+
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
-} ftable;
+  struct fpage *pages;
+} fpool;
+
+// Carve a new page into files for the pool.
+// Caller must hold fpool.lock.
+static void
+filegrow(void)
+{
+  struct fpage *pg;
+  struct file *f;
+  int i;
+
+  if((pg = (struct fpage*)kalloc()) == 0)
+    return;
+  pg->free = 0;
+  pg->nfree = 0;
+  f = (struct file*)(pg + 1);
+  for(i = 0; i < FPERPAGE; i++, f++){
+    f->ref = 0;
+    f->next = pg->free;
+    pg->free = f;
+    pg->nfree++;
+  }
+  pg->next = fpool.pages;
+  fpool.pages = pg;
+}
+
+// Put free file f back on its page, and free the page
+// if that was the last of its files in use.
+// Caller must hold fpool.lock.
+static void
+fileput(struct file *f)
+{
+  struct fpage *pg = (struct fpage*)PGROUNDDOWN((uint64)f);
+  struct fpage **pp;
+
+  if(pg->nfree == 0){
+    pg->next = fpool.pages;
+    fpool.pages = pg;
+  }
+  f->next = pg->free;
+  pg->free = f;
+  if(++pg->nfree < FPERPAGE)
+    return;
+  for(pp = &fpool.pages; *pp != pg; pp = &(*pp)->next)
+    ;
+  *pp = pg->next;
+  kfree((void*)pg);
+}
 
 void
 fileinit(void)
 {
-  initlock(&ftable.lock, "ftable");
+  initlock(&fpool.lock, "fpool");
+}
+
+// Move up to FBATCH files from the pool to c's list, first
+// refilling the pool from a new page if it's empty.
+// Caller must have interrupts off.
+static void
+filerefill(struct cpu *c)
+{
+  struct fpage *pg;
+  struct file *f;
+  int i;
+
+  acquire(&fpool.lock);
+  if(fpool.pages == 0)
+    filegrow();
+  for(i = 0; i < FBATCH && (pg = fpool.pages) != 0; i++){
+    f = pg->free;
+    pg->free = f->next;
+    if(--pg->nfree == 0)
+      fpool.pages = pg->next;
+    f->next = c->ffree;
+    c->ffree = f;
+    c->nffree++;
+  }
+  release(&fpool.lock);
 }
 
 // Allocate a file structure.
 struct file*
 filealloc(void)
 {
+  struct cpu *c;
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
+  push_off();
+  c = mycpu();
+  if(c->ffree == 0)
+    filerefill(c);
+  if((f = c->ffree) != 0){
+    c->ffree = f->next;
+    c->nffree--;
+    f->ref = 1;
+    f->type = FD_NONE;
+    f->nonblock = 0;
+  }
+  pop_off();
+  return f;
+}
+
+// Put f, whose last reference has gone, on this cpu's list.
+static void
+filefree(struct file *f)
+{
+  struct cpu *c;
+  int i;
+
+  push_off();
+  c = mycpu();
+  f->next = c->ffree;
+  c->ffree = f;
+  if(++c->nffree > 2*FBATCH){
+    acquire(&fpool.lock);
+    for(i = 0; i < FBATCH; i++){
+      f = c->ffree;
+      c->ffree = f->next;
+      c->nffree--;
+      fileput(f);
     }
+    release(&fpool.lock);
   }
-  release(&ftable.lock);
-  return 0;
+  pop_off();
 }
 
 // Increment ref count for file f.
 struct file*
 filedup(struct file *f)
 {
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  if(__sync_fetch_and_add(&f->ref, 1) < 1)
     panic("filedup");
-  f->ref++;
-  release(&ftable.lock);
   return f;
 }
 
@@ -60,18 +179,15 @@ void
 fileclose(struct file *f)
 {
   struct file ff;
+  int ref;
 
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  if((ref = __sync_sub_and_fetch(&f->ref, 1)) < 0)
     panic("fileclose");
-  if(--f->ref > 0){
-    release(&ftable.lock);
+  if(ref > 0)
     return;
-  }
   ff = *f;
-  f->ref = 0;
   f->type = FD_NONE;
-  release(&ftable.lock);
+  filefree(f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -91,7 +207,7 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, &st);
     iunlock(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
@@ -101,26 +217,100 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Get or set a property of file f, for fcntl().
+int
+filefcntl(struct file *f, int cmd, int arg)
+{
+  switch(cmd){
+  case F_GETPIPE_SZ:
+    if(f->type != FD_PIPE)
+      return -1;
+    return pipesize(f->pipe);
+  case F_SETPIPE_SZ:
+    if(f->type != FD_PIPE)
+      return -1;
+    return pipesetsize(f->pipe, arg);
+  case F_GETFL:
+    return (f->readable ? (f->writable ? O_RDWR : O_RDONLY) : O_WRONLY) |
+           (f->nonblock ? O_NONBLOCK : 0);
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
+// Which of events f is ready for, as POLL* bits, for poll().
+// If pt isn't 0, also arrange for pt to be woken when that
+// may change. Inodes, and devices without a poll routine,
+// are always ready.
+int
+filepoll(struct file *f, int events, struct polltable *pt)
+{
+  int r;
+
+  if(f->type == FD_PIPE)
+    r = pipepoll(f->pipe, f->writable, pt);
+  else if(f->type == FD_DEVICE && f->major >= 0 && f->major < NDEV &&
+          devsw[f->major].poll)
+    r = devsw[f->major].poll(pt);
+  else
+    r = POLLIN | POLLOUT;
+  if(!f->readable)
+    r &= ~POLLIN;
+  if(!f->writable)
+    r &= ~POLLOUT;
+  return r & (events | POLLERR | POLLHUP);
+}
+
+// Make f's changes durable, for fsync(), or for fdatasync()
+// if datasync, just what's needed to read its data back.
+// Commits only the transaction that last changed the inode,
+// and only if it isn't on disk yet.
+int
+filesync(struct file *f, int datasync)
+{
+  uint64 tid;
+
+  if(f->type == FD_PIPE)
+    return -1;
+  ilockshared(f->ip);
+  tid = datasync ? f->ip->datatid : f->ip->tid;
+  iunlock(f->ip);
+  log_force(tid);
+  return 0;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
 fileread(struct file *f, uint64 addr, int n)
 {
   int r = 0;
+  uint off;
 
   if(f->readable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
+    // a device's read routine always waits, so check first.
+    if(f->nonblock && devsw[f->major].poll &&
+       (devsw[f->major].poll(0) & POLLIN) == 0)
+      return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
+    // readers share the inode lock, so another read of f
+    // may move f->off meanwhile; if so, read again from
+    // where it left off.
+    ilockshared(f->ip);
+    do {
+      off = f->off;
+      r = readi(f->ip, 1, addr, off, n);
+    } while(r > 0 && !__sync_bool_compare_and_swap(&f->off, off, off + r));
     iunlock(f->ip);
   } else {
     panic("fileread");
@@ -129,54 +319,363 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
+// Read from file f into the cnt buffers of iov, in order,
+// stopping early at the end of the file.
+// iov is in kernel memory; the buffers are user addresses.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, tot;
+  uint off;
+
+  if(f->readable == 0)
+    return -1;
+  for(i = 0; i < cnt; i++)
+    if(iov[i].iov_len < 0)
+      return -1;
+
+  if(f->type == FD_INODE){
+    // one lock hold for all the buffers; retry as in
+    // fileread() if another read moves f->off meanwhile.
+    ilockshared(f->ip);
+    do {
+      off = f->off;
+      tot = 0;
+      for(i = 0; i < cnt; i++){
+        r = readi(f->ip, 1, (uint64)iov[i].iov_base, off + tot, iov[i].iov_len);
+        if(r < 0 && tot == 0)
+          tot = -1;
+        if(r > 0)
+          tot += r;
+        if(r != iov[i].iov_len)
+          break;
+      }
+    } while(tot > 0 && !__sync_bool_compare_and_swap(&f->off, off, off + tot));
+    iunlock(f->ip);
+    return tot;
+  }
+
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    r = fileread(f, (uint64)iov[i].iov_base, iov[i].iov_len);
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r != iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
+
+// Read from offset off of file f, which must be an inode,
+// without using or moving f->off.
+int
+filepread(struct file *f, uint64 addr, int n, uint off)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  ilockshared(f->ip);
+  r = readi(f->ip, 1, addr, off, n);
+  iunlock(f->ip);
+  return r;
+}
+
+// Write the cnt buffers of iov, one after the other, to the
+// inode of f at *off, advancing *off. Buffers that fit in one
+// transaction share it, and the inode lock hold. The buffers
+// are user addresses if user, else kernel addresses.
+static int
+inodewrite(struct file *f, int user, struct iovec *iov, int cnt, uint *off)
+{
+  int i, r, n, n1, room, done = 0, err = 0;
+  int pos = 0;    // bytes of iov[i] already written
+
+  n = 0;
+  for(i = 0; i < cnt; i++){
+    if(iov[i].iov_len < 0)
+      return -1;
+    n += iov[i].iov_len;
+  }
+
+  // write a few blocks at a time to avoid exceeding
+  // the maximum log transaction size, including
+  // i-node, indirect block, allocation blocks,
+  // and 2 blocks of slop for non-aligned writes.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  i = 0;
+  while(done < n && !err){
+    room = max;
+    begin_op();
+    ilock(f->ip);
+    while(room > 0 && i < cnt){
+      n1 = iov[i].iov_len - pos;
+      if(n1 > room)
+        n1 = room;
+      if(n1 > 0){
+        if((r = writei(f->ip, user, (uint64)iov[i].iov_base + pos, *off, n1)) > 0){
+          *off += r;
+          done += r;
+          room -= r;
+          pos += r;
+        }
+        if(r != n1){
+          // error from writei
+          err = 1;
+          break;
+        }
+      }
+      if(pos == iov[i].iov_len){
+        i++;
+        pos = 0;
+      }
+    }
+    iunlock(f->ip);
+    end_op();
+  }
+  return done == n ? n : -1;
+}
+
 // Write to file f.
 // addr is a user virtual address.
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
+    struct iovec iov = { (void*)addr, n };
+    ret = inodewrite(f, 1, &iov, 1, &f->off);
+  } else {
+    panic("filewrite");
+  }
+
+  return ret;
+}
+
+// Write to offset off of file f, which must be an inode,
+// without using or moving f->off.
+int
+filepwrite(struct file *f, uint64 addr, int n, uint off)
+{
+  struct iovec iov = { (void*)addr, n };
+
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return inodewrite(f, 1, &iov, 1, &off);
+}
+
+// Write the cnt buffers of iov to file f, in order.
+// iov is in kernel memory; the buffers are user addresses.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, tot;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_INODE)
+    return inodewrite(f, 1, iov, cnt, &f->off);
+
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    if((r = filewrite(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r != iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
+
+
+// sendi() sinks for filesend().
+struct isink {
+  struct inode *ip;
+  uint off;
+};
+
+static int
+inodesink(void *arg, char *src, int n)
+{
+  struct isink *s = arg;
+  int r;
+
+  if((r = writei(s->ip, 0, (uint64)src, s->off, n)) > 0)
+    s->off += r;
+  return r == n ? n : -1;
+}
+
+static int
+pipesink(void *arg, char *src, int n)
+{
+  return pipeput((struct pipe*)arg, src, n);
+}
+
+static int
+devsink(void *arg, char *src, int n)
+{
+  return devsw[*(short*)arg].write(0, (uint64)src, n);
+}
+
+// Move up to n bytes from file in, which must be an inode,
+// to file out, straight from the buffer cache, without
+// copying them through user space. Both files' offsets move.
+// Returns the number of bytes moved, or -1.
+int
+filesend(struct file *out, struct file *in, int n)
+{
+  struct isink s;
+  int r, n1, tot, more;
+  uint off;
+
+  // the inode locks are taken in inum order (below), but
+  // unlink() locks a directory before a file in it.
+  if(in->readable == 0 || in->type != FD_INODE || in->ip->type == T_DIR ||
+     out->writable == 0 || n < 0)
+    return -1;
+  if(out->type == FD_DEVICE &&
+     (out->major < 0 || out->major >= NDEV || !devsw[out->major].write))
+    return -1;
+  if(out->type == FD_INODE && out->ip == in->ip)
+    return -1;
+
+  // a transaction's worth at a time, as in filewrite().
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  tot = 0;
+  while(tot < n){
+    n1 = n - tot;
+    if(out->type == FD_INODE){
       if(n1 > max)
         n1 = max;
-
       begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
+      if(out->ip->inum < in->ip->inum){
+        ilock(out->ip);
+        ilockshared(in->ip);
+      } else {
+        ilockshared(in->ip);
+        ilock(out->ip);
+      }
+      // in is only locked shared, so a read of in may move
+      // in->off meanwhile; if so, write out's same bytes
+      // again from where the read left off.
+      s.ip = out->ip;
+      do {
+        s.off = out->off;
+        off = in->off;
+        r = sendi(in->ip, off, n1, inodesink, &s);
+      } while(r > 0 && !__sync_bool_compare_and_swap(&in->off, off, off + r));
+      if(r > 0)
+        out->off = s.off;
+      iunlock(in->ip);
+      iunlock(out->ip);
       end_op();
+    } else {
+      // bytes can't be taken back from a pipe or device, so
+      // lock in exclusively to keep reads from moving in->off.
+      ilock(in->ip);
+      off = in->off;
+      more = off < in->ip->size;
+      r = 0;
+      if(more && out->type == FD_PIPE)
+        r = sendi(in->ip, off, n1, pipesink, out->pipe);
+      else if(more)
+        r = sendi(in->ip, off, n1, devsink, &out->major);
+      if(r > 0)
+        in->off = off + r;
+      iunlock(in->ip);
+      // a full pipe: wait for room rather than hold a
+      // buffer and the inode lock while asleep.
+      if(r == 0 && more && out->type == FD_PIPE){
+        if(pipewaitroom(out->pipe) < 0)
+          return tot > 0 ? tot : -1;
+        continue;
+      }
+    }
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    if(r == 0)
+      break;
+    tot += r;
+  }
+  return tot;
+}
+
+// Move up to n bytes between a file and a pipe, for splice().
+// From a file, the pipe gets references to the file's pages
+// in the page cache rather than copies. Into a file, the bytes
+// go from the pipe's pages straight to writei(). Moves the
+// file's offset. Returns the number of bytes moved, or -1.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  int m, r, tot = 0;
+  uint off, poff;
+  char *pa;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
 
-      if(r != n1){
-        // error from writei
+  if(in->type == FD_INODE && out->type == FD_PIPE){
+    while(tot < n){
+      // claim the bytes before the pipe gets them, since a
+      // read of in may move in->off once in is unlocked.
+      ilockshared(in->ip);
+      do {
+        off = in->off;
+        m = 0;
+        if(off >= in->ip->size)
+          break;
+        m = n - tot;
+        if(m > PGSIZE - off % PGSIZE)
+          m = PGSIZE - off % PGSIZE;
+        if(m > in->ip->size - off)
+          m = in->ip->size - off;
+      } while(!__sync_bool_compare_and_swap(&in->off, off, off + m));
+      if(m == 0){
+        iunlock(in->ip);
         break;
       }
-      i += r;
+      pa = pcget(in->ip, PGROUNDDOWN(off), MAP_PRIVATE);
+      iunlock(in->ip);
+      if(pa == 0 || pipeaddpage(out->pipe, pa, off % PGSIZE, m) < 0){
+        if(pa)
+          kfree(pa);
+        // give the bytes back, unless in->off has moved on.
+        __sync_bool_compare_and_swap(&in->off, off + m, off);
+        return tot > 0 ? tot : -1;
+      }
+      tot += m;
     }
-    ret = (i == n ? n : -1);
-  } else {
-    panic("filewrite");
+    return tot;
   }
 
-  return ret;
-}
+  if(in->type == FD_PIPE && out->type == FD_INODE){
+    while(tot < n){
+      // like read(), wait only until there's something.
+      if((m = pipetake(in->pipe, n - tot, &pa, &poff, tot == 0)) <= 0)
+        return tot > 0 || m == 0 ? tot : -1;
+      struct iovec iov = { pa + poff, m };
+      r = inodewrite(out, 0, &iov, 1, &out->off);
+      kfree(pa);
+      if(r < 0)
+        return tot > 0 ? tot : -1;
+      tot += m;
+    }
+    return tot;
+  }
 
+  return -1;
+}
@@ -1,8 +1,10 @@
 struct file {
   enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
   int ref; // reference count
+  struct file *next; // on a free list, while ref is 0
   char readable;
   char writable;
+  char nonblock;     // O_NONBLOCK: fail reads and writes that would block
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
@@ -20,6 +22,10 @@ struct inode {
   int ref;            // Reference count
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  uint dseq;          // changes with directory content; see dcache.c
+  uint64 tid;         // log transaction that last changed it
+  uint64 datatid;     // ... that last changed its size or data
+  int mapshared;      // pages have been mapped MAP_SHARED; see pcget()
 
   short type;         // copy of disk inode
   short major;
@@ -29,10 +35,20 @@ struct inode {
   uint addrs[NDIRECT+2]; // NDIRECT+1 -> NDIRECT+2
 };
 
+// the poll()s waiting for a pipe or device to become ready;
+// see poll.c.
+struct pollhead {
+  struct spinlock lock;
+  struct pollent *list;
+};
+
+struct polltable;
+
 // map major device number to device functions.
 struct devsw {
   int (*read)(int, uint64, int);
   int (*write)(int, uint64, int);
+  int (*poll)(struct polltable*);  // 0 if always ready
 };
 
 extern struct devsw devsw[];
@@ -142,7 +142,9 @@ bfree(int dev, uint b)
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
-//   has first locked the inode.
+//   has first locked the inode. Code that only examines
+//   them can lock it shared with ilockshared(), so that
+//   readers of one inode don't wait for each other.
 //
 // Thus a typical sequence is:
 //   ip = iget(dev, inum)
@@ -234,6 +236,7 @@ iupdate(struct inode *ip)
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
   log_write(bp);
   brelse(bp);
+  ip->tid = log_tid();
 }
 
 // Find the inode with number inum on device dev
@@ -267,6 +270,9 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  // it may have changes in the open transaction from before
+  // it was last evicted.
+  ip->tid = ip->datatid = log_tid();
   release(&icache.lock);
 
   return ip;
@@ -283,6 +289,17 @@ idup(struct inode *ip)
   return ip;
 }
 
+// Source of directory sequence numbers, ip->dseq.
+// Each one is used only once, so that a dcache entry
+// can't match a later version of its directory.
+static uint dseqnext;
+
+static uint
+newdseq(void)
+{
+  return __sync_add_and_fetch(&dseqnext, 1);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -306,13 +323,31 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
-    ip->valid = 1;
+    ip->dseq = newdseq();
+    ip->mapshared = 0;
+    __atomic_store_n(&ip->valid, 1, __ATOMIC_RELEASE);
     if(ip->type == 0)
       panic("ilock: no type");
   }
 }
 
-// Unlock the given inode.
+// Lock the given inode shared, for reading only.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  // reading the inode in needs it locked exclusively.
+  // it stays valid while we hold a reference.
+  if(ip->valid == 0){
+    ilock(ip);
+    iunlock(ip);
+  }
+  acquiresleepshared(&ip->lock);
+}
+
+// Unlock the given inode, however it is locked.
 void
 iunlock(struct inode *ip)
 {
@@ -501,6 +536,8 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  ip->datatid = ip->tid;
+  pcinval(ip);
 }
 
 // Copy stat information from inode.
@@ -519,11 +556,15 @@ stati(struct inode *ip, struct stat *st)
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
+// A file mapped MAP_SHARED is read from the page cache where
+// it can be, to see stores that haven't been written back.
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  char *pa;
+  int r;
 
   if(off > ip->size || off + n < off)
     return 0;
@@ -531,14 +572,59 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
+    if(ip->mapshared && (pa = pcpeek(ip, PGROUNDDOWN(off))) != 0){
+      r = either_copyout(user_dst, dst, pa + off % PGSIZE, m);
+      kfree(pa);
+    } else {
+      bp = bread(ip->dev, bmap(ip, off/BSIZE));
+      r = either_copyout(user_dst, dst, bp->data + (off % BSIZE), m);
       brelse(bp);
+    }
+    if(r == -1){
       tot = -1;
       break;
     }
-    brelse(bp);
+  }
+  return tot;
+}
+
+// Hand up to n bytes of inode ip, from off on, to sink(arg,
+// src, m) straight out of the buffer cache, a block's worth at
+// most at a time, for sendfile(). sink returns how many bytes
+// it took, which may be fewer than m, or -1.
+// Caller must hold ip->lock. Returns the number of bytes
+// taken, or -1 if sink failed before taking any.
+int
+sendi(struct inode *ip, uint off, uint n, int (*sink)(void*, char*, int), void *arg)
+{
+  uint tot, m;
+  int r;
+  struct buf *bp;
+  char *pa;
+
+  if(off > ip->size || off + n < off)
+    return 0;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=r, off+=r){
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(ip->mapshared && (pa = pcpeek(ip, PGROUNDDOWN(off))) != 0){
+      // see readi().
+      r = sink(arg, pa + off % PGSIZE, m);
+      kfree(pa);
+    } else {
+      bp = bread(ip->dev, bmap(ip, off/BSIZE));
+      r = sink(arg, (char*)bp->data + (off % BSIZE), m);
+      brelse(bp);
+    }
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    if(r < m){
+      tot += r;
+      break;
+    }
   }
   return tot;
 }
@@ -561,6 +647,13 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  // invalidate dcache entries for a directory before
+  // changing it; see dcacheget().
+  if(ip->type == T_DIR){
+    __atomic_store_n(&ip->dseq, newdseq(), __ATOMIC_RELEASE);
+    __sync_synchronize();
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
@@ -569,6 +662,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       break;
     }
     log_write(bp);
+    pcwrite(ip, off, (char*)bp->data + (off % BSIZE), m);
     brelse(bp);
   }
 
@@ -579,6 +673,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   // because the loop above might have called bmap() and added a new
   // block to ip->addrs[].
   iupdate(ip);
+  ip->datatid = ip->tid;
 
   return tot;
 }
@@ -696,14 +791,34 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  struct proc *p;
+  uint inum, seq;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(myproc()->cwd);
+  else {
+    // another thread may chdir() meanwhile.
+    p = myproc()->leader;
+    acquire(&p->shlock);
+    ip = idup(p->cwd);
+    release(&p->shlock);
+  }
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    // fast path: take the step from the dcache without
+    // locking ip, if ip hasn't changed meanwhile.
+    if(!(nameiparent && *path == '\0') &&
+       (inum = dcacheget(ip, name, &seq)) != 0){
+      next = iget(ip->dev, inum);
+      if(__atomic_load_n(&ip->dseq, __ATOMIC_ACQUIRE) == seq){
+        iput(ip);
+        ip = next;
+        continue;
+      }
+      iput(next);
+    }
+
+    ilockshared(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
       return 0;
@@ -717,6 +832,7 @@ namex(char *path, int nameiparent, char *name)
       iunlockput(ip);
       return 0;
     }
+    dcacheput(ip, name, next->inum, ip->dseq);
     iunlockput(ip);
     ip = next;
   }
@@ -0,0 +1,90 @@
+// Futexes: sleeping on a word of user memory.
+//
+// futex_wait(addr, val) sleeps as long as the int at addr
+// holds val, and futex_wake(addr, n) wakes up to n of the
+// sleepers. Both key on the physical address behind addr, so
+// threads meet on the same futex, and so do processes that
+// share the page with MAP_SHARED. The sleepers go on sleep()'s
+// wait queues under that key; a lock per key hash here makes
+// checking *addr and going to sleep atomic with respect to
+// futex_wake(), so a wakeup can't slip in between.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NFUTEX 64
+
+static struct spinlock futexlock[NFUTEX];
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEX; i++)
+    initlock(&futexlock[i], "futex");
+}
+
+static struct spinlock*
+futexhash(uint64 key)
+{
+  return &futexlock[((key * 0x9E3779B97F4A7C15UL) >> 32) % NFUTEX];
+}
+
+// The key of the futex at user address addr, or 0 if
+// addr is misaligned or not mapped.
+static uint64
+futexkey(uint64 addr)
+{
+  uint64 pa;
+
+  if(addr % sizeof(int))
+    return 0;
+  if((pa = uvmaddr(myproc()->pagetable, addr, 0)) == 0)
+    return 0;
+  return pa + (addr % PGSIZE);
+}
+
+// Sleep until woken by futexwake(), if the int at user
+// address addr holds val. Returns 0 when woken, or -1 if
+// *addr didn't hold val, addr is bad, or the caller was
+// killed. As with any futex, a wakeup may be spurious.
+int
+futexwait(uint64 addr, int val)
+{
+  struct spinlock *lk;
+  uint64 key;
+  int r = -1;
+
+  if((key = futexkey(addr)) == 0)
+    return -1;
+  lk = futexhash(key);
+  acquire(lk);
+  if(*(volatile int*)key == val && !myproc()->killed){
+    sleep((void*)key, lk);
+    r = myproc()->killed ? -1 : 0;
+  }
+  release(lk);
+  return r;
+}
+
+// Wake up to n processes waiting on the futex at user
+// address addr. Returns the number woken, or -1.
+int
+futexwake(uint64 addr, int n)
+{
+  struct spinlock *lk;
+  uint64 key;
+  int r;
+
+  if(n <= 0 || (key = futexkey(addr)) == 0)
+    return -1;
+  lk = futexhash(key);
+  acquire(lk);
+  r = wakeupn((void*)key, n);
+  release(lk);
+  return r;
+}
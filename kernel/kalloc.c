@@ -1,12 +1,15 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// and, for huge-page user mappings, physically
+// contiguous 2MB-aligned megapages.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
 
 void freerange(void *pa_start, void *pa_end);
@@ -14,15 +17,36 @@ void freerange(void *pa_start, void *pa_end);
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// the free list is doubly linked so that kallocmega()
+// can take pages out of the middle of it.
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
+// index of a physical page in kmem.ref[].
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
 struct {
   struct spinlock lock;
   struct run *freelist;
+  // number of references to each page (page tables that map it,
+  // plus the page cache), so that read-only pages can be shared.
+  int ref[(PHYSTOP - KERNBASE) / PGSIZE];
 } kmem;
 
+// Take r off the free list. Caller must hold kmem.lock.
+static void
+unlinkrun(struct run *r)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.freelist = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+}
+
 void
 kinit()
 {
@@ -35,12 +59,15 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kmem.ref[PA2REF(p)] = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
+// Drop a reference to the page of physical memory pointed
+// at by v, and free it if that was the last reference.
+// The page normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
 void
@@ -51,32 +78,146 @@ kfree(void *pa)
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  acquire(&kmem.lock);
+  if(kmem.ref[PA2REF(pa)] < 1)
+    panic("kfree ref");
+  if(kmem.ref[PA2REF(pa)] > 1){
+    kmem.ref[PA2REF(pa)]--;
+    release(&kmem.lock);
+    return;
+  }
+  release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
+  // the count drops to zero only once the page is on the
+  // free list, since kallocmega() takes zero to mean free.
   acquire(&kmem.lock);
   r->next = kmem.freelist;
+  r->prev = 0;
+  if(kmem.freelist)
+    kmem.freelist->prev = r;
   kmem.freelist = r;
+  kmem.ref[PA2REF(pa)] = 0;
   release(&kmem.lock);
 }
 
+// Charge the current process, if any, for n pages.
+static void
+kcharge(int n)
+{
+  struct proc *p = myproc();
+
+  if(p)
+    __sync_fetch_and_add(&p->leader->ru.npages, n);
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
+// If the free list is empty, ask the page cache
+// to give back pages that no process is using.
 void *
 kalloc(void)
 {
   struct run *r;
+  int tries;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  for(tries = 0; tries < 2; tries++){
+    acquire(&kmem.lock);
+    r = kmem.freelist;
+    if(r){
+      unlinkrun(r);
+      kmem.ref[PA2REF(r)] = 1;
+    }
+    release(&kmem.lock);
+
+    if(r || pcreclaim() == 0)
+      break;
+  }
 
-  if(r)
+  if(r){
     memset((char*)r, 5, PGSIZE); // fill with junk
+    kcharge(1);
+  }
   return (void*)r;
 }
+
+// Add a reference to a page returned by kalloc(),
+// for a second page table or cache that maps it.
+void
+kdup(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kdup");
+
+  acquire(&kmem.lock);
+  if(kmem.ref[PA2REF(pa)] < 1)
+    panic("kdup ref");
+  kmem.ref[PA2REF(pa)]++;
+  release(&kmem.lock);
+}
+
+// Return the number of references to a page.
+int
+krefs(void *pa)
+{
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem.ref[PA2REF(pa)];
+  release(&kmem.lock);
+  return n;
+}
+
+// Allocate a physically contiguous, MEGAPGSIZE-aligned
+// 2MB megapage, for a huge-page user mapping. Each of its
+// 4096-byte pages gets a reference, so it can be freed
+// with kfreemega() or page by page with kfree().
+// Returns 0 if no free, aligned run of pages is left.
+void *
+kallocmega(void)
+{
+  uint64 pa, a;
+  int tries;
+
+  for(tries = 0; tries < 2; tries++){
+    acquire(&kmem.lock);
+    for(pa = MEGAPGROUNDUP((uint64)end); pa + MEGAPGSIZE <= PHYSTOP; pa += MEGAPGSIZE){
+      // a page is free if nothing refers to it.
+      for(a = pa; a < pa + MEGAPGSIZE; a += PGSIZE)
+        if(kmem.ref[PA2REF(a)] != 0)
+          break;
+      if(a < pa + MEGAPGSIZE)
+        continue;
+      for(a = pa; a < pa + MEGAPGSIZE; a += PGSIZE){
+        unlinkrun((struct run*)a);
+        kmem.ref[PA2REF(a)] = 1;
+      }
+      release(&kmem.lock);
+      memset((char*)pa, 5, MEGAPGSIZE); // fill with junk
+      kcharge(MEGAPGSIZE / PGSIZE);
+      return (void*)pa;
+    }
+    release(&kmem.lock);
+
+    if(pcreclaim() == 0)
+      break;
+  }
+  return 0;
+}
+
+// Free a megapage returned by kallocmega().
+void
+kfreemega(void *pa)
+{
+  char *p;
+
+  if(((uint64)pa % MEGAPGSIZE) != 0)
+    panic("kfreemega");
+  for(p = (char*)pa; p < (char*)pa + MEGAPGSIZE; p += PGSIZE)
+    kfree(p);
+}
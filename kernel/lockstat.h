@@ -0,0 +1,9 @@
+// Spinlock statistics for all the locks with one name,
+// as returned by lockstat().
+struct lockstat {
+  char name[16];
+  int nlock;         // Number of locks with this name
+  uint64 nacquire;   // Times acquired
+  uint64 ncontend;   // Times acquire() found it held
+  uint64 nspin;      // Spin iterations waiting for it
+};
@@ -1,4 +1,5 @@
 #include "types.h"
+#include "memlayout.h"
 #include "riscv.h"
 #include "defs.h"
 #include "param.h"
@@ -6,6 +7,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "proc.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -29,6 +31,14 @@
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// Commits can be deferred, with commitdelay(ticks). Then the
+// last end_op() leaves the transaction open for later system
+// calls to join, and it commits only when it runs out of log
+// space, when fsync() or sync() forces it with log_force(),
+// or when the flusher thread finds it older than the delay.
+// Each transaction has an id; an inode remembers the one that
+// last changed it, so fsync() need only wait for that one.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -45,9 +55,18 @@ struct log {
   int committing;  // in commit(), please wait.
   int dev;
   struct logheader lh;
+  uint64 tid;      // id of the open transaction
+  uint64 committed; // id of the last transaction on disk
+  int delay;       // ticks a commit may be deferred; 0 for none
+  uint64 since;    // r_time() of the open transaction's first write
+  int force;       // log_force() wants the open transaction
+  int flusher;     // flusher thread running?
+  uint64 ncommit;  // commits that wrote something
 };
 struct log log;
 
+extern struct proc *initproc;
+
 static void recover_from_log(void);
 static void commit();
 
@@ -61,6 +80,7 @@ initlog(int dev, struct superblock *sb)
   log.start = sb->logstart;
   log.size = sb->nlog;
   log.dev = dev;
+  log.tid = 1;
   recover_from_log();
 }
 
@@ -122,6 +142,26 @@ recover_from_log(void)
   write_head(); // clear the log
 }
 
+// Commit the open transaction, and start the next.
+// Caller must hold log.lock, with no FS system calls active
+// and no commit in progress; commit() runs without it.
+static void
+docommit(void)
+{
+  log.committing = 1;
+  if(log.lh.n > 0)
+    log.ncommit++;
+  release(&log.lock);
+  commit();
+  acquire(&log.lock);
+  log.committing = 0;
+  log.committed = log.tid++;
+  log.since = 0;
+  log.force = 0;
+  wakeup(&log.committed);
+  wakeupone(&log);
+}
+
 // called at the start of each FS system call.
 void
 begin_op(void)
@@ -131,47 +171,143 @@ begin_op(void)
     if(log.committing){
       sleep(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
-      sleep(&log, &log.lock);
+      // this op might exhaust log space; wait for commit,
+      // or commit now if it was deferred.
+      if(log.outstanding == 0)
+        docommit();
+      else
+        sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      // end_op() wakes just one waiter; pass it on, in case
+      // there is room for the next one too.
+      wakeupone(&log);
       release(&log.lock);
       break;
     }
   }
 }
 
+// Has the open transaction been deferred for long enough?
+// Caller must hold log.lock.
+static int
+overdue(void)
+{
+  return log.since && r_time() - log.since >= (uint64)log.delay * TICKINTERVAL;
+}
+
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits if this was the last outstanding operation,
+// unless commits are deferred.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
   if(log.committing)
     panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+  if(log.outstanding == 0 && (log.delay == 0 || log.force || overdue())){
+    docommit();
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
     // the amount of reserved space.
-    wakeup(&log);
+    wakeupone(&log);
+  }
+  release(&log.lock);
+}
+
+// The id of the open transaction, which the current FS
+// system call's changes are part of.
+uint64
+log_tid(void)
+{
+  return __atomic_load_n(&log.tid, __ATOMIC_RELAXED);
+}
+
+// Wait until transaction tid is on disk, committing it if
+// it's still open, for fsync() and sync().
+void
+log_force(uint64 tid)
+{
+  acquire(&log.lock);
+  while(log.committed < tid){
+    if(log.tid == tid && log.lh.n == 0 && !log.committing)
+      break;    // open, but nothing to commit.
+    if(log.committing || log.outstanding > 0){
+      // the last end_op() will commit it.
+      log.force = 1;
+      sleep(&log.committed, &log.lock);
+    } else {
+      docommit();
+    }
   }
   release(&log.lock);
+}
+
+// Commit the open transaction every log.delay ticks while
+// commits are deferred. A kernel thread of the init process,
+// which commitdelay() starts, and which exits once commits
+// aren't deferred any more, or if killed; init's wait() then
+// frees it.
+static void
+flusher(void)
+{
+  struct proc *p = myproc();
+  int delay;
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
+  // still holding p->lock from scheduler, as in forkret().
+  release(&p->lock);
+
+  for(;;){
     acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
+    delay = log.delay;
+    if(delay == 0 || p->killed){
+      log.flusher = 0;
+      release(&log.lock);
+      break;
+    }
     release(&log.lock);
+    if(timersleep(r_time() + (uint64)delay * TICKINTERVAL) == 0)
+      log_force(log_tid());
   }
+  exit(0);
+}
+
+// Let commits be deferred by up to delay ticks, or not at all
+// if delay is 0; a negative delay changes nothing. Returns
+// the previous delay.
+int
+commitdelay(int delay)
+{
+  int old, start;
+
+  if(delay < 0)
+    return log.delay;
+  acquire(&log.lock);
+  old = log.delay;
+  log.delay = delay;
+  start = delay > 0 && !log.flusher;
+  if(start)
+    log.flusher = 1;
+  release(&log.lock);
+
+  if(start && kthread(initproc, flusher, "flusher") < 0){
+    acquire(&log.lock);
+    log.flusher = 0;
+    release(&log.lock);
+  }
+  // what's already in the log needn't wait any longer.
+  if(delay == 0)
+    log_force(log_tid());
+  return old;
+}
+
+// The number of transactions that have written to the disk.
+uint64
+log_ncommit(void)
+{
+  return log.ncommit;
 }
 
 // Copy modified blocks from cache to log.
@@ -214,12 +350,15 @@ commit()
 void
 log_write(struct buf *b)
 {
+  struct proc *p = myproc();
   int i;
 
   if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
+  if(p)
+    __sync_fetch_and_add(&p->leader->ru.oublock, 1);
 
   acquire(&log.lock);
   for (i = 0; i < log.lh.n; i++) {
@@ -230,6 +369,8 @@ log_write(struct buf *b)
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
     log.lh.n++;
+    if(log.since == 0)
+      log.since = r_time();
   }
   release(&log.lock);
 }
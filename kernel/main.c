@@ -19,12 +19,21 @@ main()
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+#ifdef MEMBENCH
+    kvmbench();      // memory bandwidth through the direct map
+#endif
     procinit();      // process table
+    tminit();        // deadline timers
+    profinit();      // sampling profiler
+    futexinit();     // futex locks
+    rcuinit();       // deferred reclamation
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
+    pcinit();        // page cache
+    dcacheinit();    // directory entry cache
     iinit();         // inode cache
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
@@ -41,5 +50,8 @@ main()
     plicinithart();   // ask PLIC for device interrupts
   }
 
+#ifdef RCUTEST
+  rcutest();          // every hart takes part
+#endif
   scheduler();        
 }
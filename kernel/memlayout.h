@@ -27,8 +27,11 @@
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid))
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define TIMEBASE 10000000L // CLINT_MTIME (and time CSR) cycles per second.
+#define TICKINTERVAL (TIMEBASE/10) // cycles per scheduling tick.
 
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
@@ -62,6 +65,15 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   mmap() regions, allocated downwards from MMAPTOP
+//   ...
+//   CLOCKPAGE (p->clock, read-only; see clock.h)
+//   RING (the shared page of ringsetup())
+//   threads' trapframes, one page per proc[] slot
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define THREADTRAPFRAME(p) (TRAPFRAME - ((p)+1)*PGSIZE)
+#define RING (TRAPFRAME - (NPROC+1)*PGSIZE)
+#define CLOCKPAGE (RING - PGSIZE)
+#define MMAPTOP (MAXVA - MEGAPGSIZE)
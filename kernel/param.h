@@ -4,15 +4,25 @@
 #define NPROC        64  // maximum number of processes (speedsup bigfile)
 #endif
 #define NCPU          8  // maximum number of CPUs
-#define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
+#define NOFILE       16  // open files per process, before its table grows
+#define NOFILEMAX   512  // open files per process: a page of pointers
+#define NPOLL        16  // most fds in one poll()
+#define NPROFBUF    512  // profiling samples buffered per cpu
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NBUF         (LOGSIZE+MAXOPBLOCKS*2)  // size of disk block cache; more than the log pins
+#define NPCACHE     256  // pages in the file page cache
+#define NVMA         16  // demand-paged regions per process
+#define NRINGWORKER   4  // worker threads per ringsetup()
+#define NSHARED       4  // sleeplocks a process can hold shared at once
+#define NWAITQ       64  // sleep() wait queues, hashed by chan
+#define NLOCK        500 // spinlocks tracked by lockstat()
+#define NPRIO         3  // scheduler priority levels
+#define BOOSTTICKS   10  // ticks between scheduler priority resets
 #define FSSIZE       200000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
 #define MAX_SYMLINK_DEPTH 10 //  如果链接的深度达到某个阈值（例如10），则返回错误代码。
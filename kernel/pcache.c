@@ -0,0 +1,290 @@
+// Page cache.
+//
+// The page cache holds whole pages of file content, keyed by
+// (device, inode number, page-aligned file offset). exec() maps
+// the read-only text of a program straight out of the cache, so
+// every process running the same binary shares one physical copy
+// of each text page, and a page is read from disk (through the
+// buffer cache) only the first time any process touches it.
+//
+// Each cached page holds one kalloc() reference of its own; each
+// page table that maps the page holds another. Evicting a page
+// only drops the cache's reference, so processes that still map
+// it are unaffected.
+//
+// Interface:
+// * pcget(ip, off, how) returns the page holding file offset
+//   off, with a new reference for the caller. ip must be locked,
+//   perhaps shared. how says what the caller will do with the
+//   page: map it MAP_SHARED, keep it MAP_PRIVATE as a snapshot
+//   (program text, or a page spliced into a pipe), or 0, just
+//   copy it.
+// * pcwrite() keeps cached pages in step with writei(). A page
+//   that a MAP_PRIVATE holder still has is not changed, since
+//   that would change the text of running programs; the cache
+//   forgets it instead, and reads the new content next time.
+//   MAP_SHARED mappings see the change, even if a private
+//   holder shares the page with them.
+// * pcpeek() returns a page only if it is cached, so that read()
+//   sees stores through MAP_SHARED mappings at once.
+// * pcinval() forgets every page of an inode (on truncation).
+// * pcreclaim() gives pages that nobody maps back to kalloc().
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;           // page-aligned file offset
+  char *pa;           // cached content, or 0 if slot is free
+  int priv;           // given out MAP_PRIVATE
+  int shared;         // given out MAP_SHARED
+  struct pcpage *prev; // LRU list
+  struct pcpage *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct pcpage page[NPCACHE];
+
+  // Linked list of all pages, through prev/next.
+  // head.next is most recently used, head.prev is least.
+  struct pcpage head;
+} pcache;
+
+void
+pcinit(void)
+{
+  struct pcpage *pg;
+
+  initlock(&pcache.lock, "pcache");
+
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  for(pg = pcache.page; pg < pcache.page+NPCACHE; pg++){
+    pg->next = pcache.head.next;
+    pg->prev = &pcache.head;
+    pcache.head.next->prev = pg;
+    pcache.head.next = pg;
+  }
+}
+
+// Move pg to the most-recently-used end of the list.
+// Caller must hold pcache.lock.
+static void
+pctouch(struct pcpage *pg)
+{
+  pg->next->prev = pg->prev;
+  pg->prev->next = pg->next;
+  pg->next = pcache.head.next;
+  pg->prev = &pcache.head;
+  pcache.head.next->prev = pg;
+  pcache.head.next = pg;
+}
+
+// Forget pg, dropping the cache's reference to its page.
+// Caller must hold pcache.lock.
+static void
+pcdrop(struct pcpage *pg)
+{
+  char *pa = pg->pa;
+
+  pg->pa = 0;
+  pg->dev = 0;
+  pg->inum = 0;
+  pg->priv = 0;
+  pg->shared = 0;
+  kfree(pa);
+}
+
+// Give the caller of pcget() a reference to pg's page.
+// Caller must hold pcache.lock and ip->lock.
+static void
+pcgive(struct inode *ip, struct pcpage *pg, int how)
+{
+  kdup(pg->pa);
+  pctouch(pg);
+  if(how & MAP_PRIVATE)
+    pg->priv = 1;
+  if(how & MAP_SHARED){
+    pg->shared = 1;
+    ip->mapshared = 1;
+  }
+}
+
+// Find the cached page for (dev, inum, off), or 0.
+// Caller must hold pcache.lock.
+static struct pcpage*
+pclookup(uint dev, uint inum, uint off)
+{
+  struct pcpage *pg;
+
+  for(pg = pcache.head.next; pg != &pcache.head; pg = pg->next){
+    if(pg->pa && pg->dev == dev && pg->inum == inum && pg->off == off)
+      return pg;
+  }
+  return 0;
+}
+
+// Return the page of ip's content that starts at file offset off,
+// reading it from the file if it is not cached. Bytes past the end
+// of the file are zero. The caller gets its own reference to the
+// page and must kfree() it when done. off must be page-aligned.
+// how is MAP_SHARED, MAP_PRIVATE or 0; see above.
+// Caller must hold ip->lock, perhaps shared, so two readers may
+// fill the same page at once; the second to finish uses the
+// first one's copy.
+// Returns 0 if out of memory, or if how is MAP_SHARED and
+// every cached page is in use.
+char*
+pcget(struct inode *ip, uint off, int how)
+{
+  struct pcpage *pg;
+  char *mem;
+
+  if(!holdingsleep(&ip->lock) || off % PGSIZE)
+    panic("pcget");
+
+  acquire(&pcache.lock);
+  if((pg = pclookup(ip->dev, ip->inum, off)) != 0){
+    pcgive(ip, pg, how);
+    release(&pcache.lock);
+    return pg->pa;
+  }
+  release(&pcache.lock);
+
+  // Not cached. Read it without holding pcache.lock,
+  // since readi() sleeps and kalloc() may call pcreclaim().
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  if(readi(ip, 0, (uint64)mem, off, PGSIZE) < 0){
+    kfree(mem);
+    return 0;
+  }
+
+  acquire(&pcache.lock);
+  if((pg = pclookup(ip->dev, ip->inum, off)) != 0){
+    kfree(mem);
+    pcgive(ip, pg, how);
+    release(&pcache.lock);
+    return pg->pa;
+  }
+
+  // Recycle the least recently used slot whose page nobody
+  // holds, so that every MAP_SHARED mapping of a file page
+  // keeps using the one copy. If all pages are held, a caller
+  // that will only copy the page, or keep it private, can have
+  // it uncached; a MAP_SHARED one fails.
+  for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev){
+    if(pg->pa == 0 || krefs(pg->pa) == 1)
+      break;
+  }
+  if(pg == &pcache.head){
+    release(&pcache.lock);
+    if(how & MAP_SHARED){
+      kfree(mem);
+      return 0;
+    }
+    return mem;
+  }
+  if(pg->pa)
+    pcdrop(pg);
+  pg->dev = ip->dev;
+  pg->inum = ip->inum;
+  pg->off = off;
+  pg->pa = mem;
+  pcgive(ip, pg, how);   // one reference for the cache, one for the caller.
+  release(&pcache.lock);
+
+  return mem;
+}
+
+// Return ip's cached page at file offset off, with a reference
+// for the caller, or 0 if it isn't cached. For readi() and
+// sendi() of a file mapped MAP_SHARED, whose cached pages may
+// hold stores not yet written back.
+// Caller must hold ip->lock, perhaps shared.
+char*
+pcpeek(struct inode *ip, uint off)
+{
+  struct pcpage *pg;
+  char *pa = 0;
+
+  acquire(&pcache.lock);
+  if((pg = pclookup(ip->dev, ip->inum, off)) != 0){
+    pa = pg->pa;
+    kdup(pa);
+  }
+  release(&pcache.lock);
+  return pa;
+}
+
+// writei() has just stored n bytes at file offset off from src;
+// copy them into the cached page, if there is one, so that later
+// pcget()s see the new content. The bytes must not cross a page.
+// Caller must hold ip->lock.
+void
+pcwrite(struct inode *ip, uint off, char *src, uint n)
+{
+  struct pcpage *pg;
+  char *dst;
+
+  acquire(&pcache.lock);
+  if((pg = pclookup(ip->dev, ip->inum, PGROUNDDOWN(off))) != 0){
+    if(pg->priv && krefs(pg->pa) == 1)
+      pg->priv = 0;  // no private holders left.
+    if(pg->priv && !pg->shared){
+      // leave the old content to its private holders.
+      pcdrop(pg);
+    } else {
+      dst = pg->pa + off % PGSIZE;
+      if(dst != src)
+        memmove(dst, src, n);
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Forget all cached pages of ip, e.g. because it has been
+// truncated. Processes that map the old pages keep them.
+void
+pcinval(struct inode *ip)
+{
+  struct pcpage *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.page; pg < pcache.page+NPCACHE; pg++){
+    if(pg->pa && pg->dev == ip->dev && pg->inum == ip->inum)
+      pcdrop(pg);
+  }
+  release(&pcache.lock);
+}
+
+// Free cached pages that no page table maps.
+// Called by kalloc() when memory runs out.
+// Returns the number of pages freed.
+int
+pcreclaim(void)
+{
+  struct pcpage *pg;
+  int n = 0;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev){
+    if(pg->pa && krefs(pg->pa) == 1){
+      pcdrop(pg);
+      n++;
+    }
+  }
+  release(&pcache.lock);
+  return n;
+}
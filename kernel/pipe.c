@@ -1,3 +1,18 @@
+// Pipes.
+//
+// A pipe's data is a ring of up to PIPEBUFS page references,
+// each with a span of unread bytes. write() appends to the
+// newest page while it has room and belongs to the pipe, and
+// otherwise adds a fresh page; read() consumes from the oldest
+// and drops each page once it's empty. Both copy a whole span
+// at a time, and each side wakes the other only if it's asleep
+// and has something worth waking for. fcntl(F_SETPIPE_SZ) sets
+// how many pages a pipe may hold. poll()s wait on the pipe's
+// pollhead for the same changes that wake readers and writers.
+// splice() moves pages of a file's page cache into a pipe by
+// reference, without copying them, and pages out of a pipe
+// into a file.
+
 #include "types.h"
 #include "riscv.h"
 #include "defs.h"
@@ -7,12 +22,27 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
+
+#define PIPEBUFS 16
 
-#define PIPESIZE 512
+struct pipebuf {
+  char *pa;       // page, with a kalloc() reference for the pipe
+  uint off;       // first unread byte in it
+  uint len;       // unread bytes
+  int mine;       // the pipe's own page, so writes may append?
+};
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  struct pipebuf buf[PIPEBUFS];
+  uint head;      // buf[head % PIPEBUFS] is the oldest
+  uint tail;      // buf[(tail-1) % PIPEBUFS] is the newest
+  uint nbufs;     // capacity, in pages
+  char *spare;    // an emptied page of the pipe's, for reuse
+  int rwait;      // number of readers asleep on nread
+  int wwait;      // number of writers asleep on nwrite
+  struct pollhead poll;
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
@@ -34,7 +64,12 @@ pipealloc(struct file **f0, struct file **f1)
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->head = pi->tail = 0;
+  pi->nbufs = PIPEBUFS;
+  pi->spare = 0;
+  pi->rwait = pi->wwait = 0;
   initlock(&pi->lock, "pipe");
+  initpollhead(&pi->poll);
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
@@ -66,18 +101,143 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pollwake(&pi->poll, POLLIN|POLLOUT);
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    for(; pi->head != pi->tail; pi->head++)
+      kfree(pi->buf[pi->head % PIPEBUFS].pa);
+    if(pi->spare)
+      kfree(pi->spare);
+    freelock(&pi->lock);
+    freelock(&pi->poll.lock);
     kfree((char*)pi);
   } else
     release(&pi->lock);
 }
 
+// The newest page, if writes may append to it.
+// Caller must hold pi->lock.
+static struct pipebuf*
+pipelast(struct pipe *pi)
+{
+  struct pipebuf *b;
+
+  if(pi->head == pi->tail)
+    return 0;
+  b = &pi->buf[(pi->tail - 1) % PIPEBUFS];
+  if(!b->mine || b->off + b->len == PGSIZE)
+    return 0;
+  return b;
+}
+
+// Is there no room for another byte?
+// Caller must hold pi->lock.
+static int
+pipefull(struct pipe *pi)
+{
+  return pi->tail - pi->head >= pi->nbufs && pipelast(pi) == 0;
+}
+
+// Sleep until a writer adds data or closes.
+// Caller must hold pi->lock.
+static void
+waitdata(struct pipe *pi)
+{
+  pi->rwait++;
+  sleep(&pi->nread, &pi->lock);
+  pi->rwait--;
+}
+
+// Wake readers, after adding data.
+// Caller must hold pi->lock.
+static void
+wakereaders(struct pipe *pi)
+{
+  if(pi->rwait)
+    wakeup(&pi->nread);
+  pollwake(&pi->poll, POLLIN);
+}
+
+// Sleep until a reader makes room or closes, first waking any
+// readers so that they do.
+// Caller must hold pi->lock.
+static void
+waitroom(struct pipe *pi)
+{
+  wakereaders(pi);
+  pi->wwait++;
+  sleep(&pi->nwrite, &pi->lock);
+  pi->wwait--;
+}
+
+// Wake writers if there's room for them now.
+// Caller must hold pi->lock.
+static void
+wakewriters(struct pipe *pi)
+{
+  if(pipefull(pi))
+    return;
+  if(pi->wwait)
+    wakeup(&pi->nwrite);
+  pollwake(&pi->poll, POLLOUT);
+}
+
+// Find room for more bytes: the newest page, or a new one.
+// Caller must hold pi->lock and have checked !pipefull(pi).
+// Returns 0 if out of memory.
+static struct pipebuf*
+pipespace(struct pipe *pi)
+{
+  struct pipebuf *b;
+  char *pa;
+
+  if((b = pipelast(pi)) != 0)
+    return b;
+  if((pa = pi->spare) != 0)
+    pi->spare = 0;
+  else if((pa = kalloc()) == 0)
+    return 0;
+  b = &pi->buf[pi->tail++ % PIPEBUFS];
+  b->pa = pa;
+  b->off = 0;
+  b->len = 0;
+  b->mine = 1;
+  return b;
+}
+
+// Drop the oldest page if it has been read, unless it's the
+// pipe's own newest one, which writes can start over in.
+// Caller must hold pi->lock.
+static void
+pipetrim(struct pipe *pi)
+{
+  struct pipebuf *b;
+
+  if(pi->head == pi->tail)
+    return;
+  b = &pi->buf[pi->head % PIPEBUFS];
+  if(b->len > 0)
+    return;
+  if(b->mine && pi->head + 1 == pi->tail){
+    b->off = 0;
+    return;
+  }
+  if(b->mine && pi->spare == 0)
+    pi->spare = b->pa;
+  else
+    kfree(b->pa);
+  pi->head++;
+}
+
+// Write n bytes from user address addr to pi, waiting for
+// room as needed, unless nonblock; then write what fits, and
+// return -1 if nothing does.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, uint64 addr, int n, int nonblock)
 {
-  int i = 0;
+  int i = 0, m;
   struct proc *pr = myproc();
+  struct pipebuf *b;
 
   acquire(&pi->lock);
   while(i < n){
@@ -85,29 +245,44 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
-      sleep(&pi->nwrite, &pi->lock);
-    } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+    if(pipefull(pi)){ //DOC: pipewrite-full
+      if(nonblock){
+        if(i == 0)
+          i = -1;
         break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      }
+      waitroom(pi);
+      continue;
     }
+    if((b = pipespace(pi)) == 0)
+      break;
+    m = n - i;
+    if(m > PGSIZE - (b->off + b->len))
+      m = PGSIZE - (b->off + b->len);
+    if(copyin(pr->pagetable, b->pa + b->off + b->len, addr + i, m) == -1)
+      break;
+    b->len += m;
+    pi->nwrite += m;
+    i += m;
+    // a reader can start on a full page while we go on.
+    if(b->off + b->len == PGSIZE)
+      wakereaders(pi);
   }
-  wakeup(&pi->nread);
+  if(i > 0)
+    wakereaders(pi);
   release(&pi->lock);
 
   return i;
 }
 
+// Read up to n bytes from pi to user address addr, waiting
+// for some if it's empty, unless nonblock; then return -1.
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, uint64 addr, int n, int nonblock)
 {
-  int i;
+  int i, m;
   struct proc *pr = myproc();
-  char ch;
+  struct pipebuf *b;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -115,16 +290,202 @@ piperead(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
-    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    if(nonblock){
+      release(&pi->lock);
+      return -1;
+    }
+    waitdata(pi); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  for(i = 0; i < n && pi->nread != pi->nwrite; i += m){  //DOC: piperead-copy
+    pipetrim(pi);
+    b = &pi->buf[pi->head % PIPEBUFS];
+    m = n - i;
+    if(m > b->len)
+      m = b->len;
+    if(copyout(pr->pagetable, addr + i, b->pa + b->off, m) == -1)
       break;
+    b->off += m;
+    b->len -= m;
+    pi->nread += m;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  pipetrim(pi);
+  wakewriters(pi);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
 }
+
+// Copy up to n bytes from kernel memory src into pi, without
+// waiting for room, for sendfile(). Returns the number copied,
+// or -1 if nobody will read them.
+int
+pipeput(struct pipe *pi, char *src, int n)
+{
+  int i = 0, m;
+  struct pipebuf *b;
+
+  acquire(&pi->lock);
+  if(pi->readopen == 0){
+    release(&pi->lock);
+    return -1;
+  }
+  while(i < n && !pipefull(pi) && (b = pipespace(pi)) != 0){
+    m = n - i;
+    if(m > PGSIZE - (b->off + b->len))
+      m = PGSIZE - (b->off + b->len);
+    memmove(b->pa + b->off + b->len, src + i, m);
+    b->len += m;
+    pi->nwrite += m;
+    i += m;
+  }
+  if(i > 0)
+    wakereaders(pi);
+  release(&pi->lock);
+  return i;
+}
+
+// Wait until pi has room for more data. Returns 0, or -1 if
+// nobody will read it or the caller has been killed.
+int
+pipewaitroom(struct pipe *pi)
+{
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while(pipefull(pi) && pi->readopen && !pr->killed)
+    waitroom(pi);
+  if(pi->readopen == 0 || pr->killed){
+    release(&pi->lock);
+    return -1;
+  }
+  release(&pi->lock);
+  return 0;
+}
+
+// Append bytes [off, off+n) of page pa to pi without copying
+// them, for splice(); the pipe takes over the caller's
+// reference to pa. The page may still change, e.g. if it's a
+// file's cached page and the file is written meanwhile.
+// Waits for a free slot. Returns 0, or -1 if nobody will read
+// the data or the caller has been killed; then the caller
+// keeps its reference.
+int
+pipeaddpage(struct pipe *pi, char *pa, uint off, uint n)
+{
+  struct proc *pr = myproc();
+  struct pipebuf *b;
+
+  acquire(&pi->lock);
+  while(pi->tail - pi->head >= pi->nbufs && pi->readopen && !pr->killed)
+    waitroom(pi);
+  if(pi->readopen == 0 || pr->killed){
+    release(&pi->lock);
+    return -1;
+  }
+  b = &pi->buf[pi->tail++ % PIPEBUFS];
+  b->pa = pa;
+  b->off = off;
+  b->len = n;
+  b->mine = 0;
+  pi->nwrite += n;
+  wakereaders(pi);
+  release(&pi->lock);
+  return 0;
+}
+
+// Take up to n bytes from the front of pi, for splice(),
+// waiting for some if it's empty and wait is set. Sets *pa to
+// their page, with a reference that the caller must kfree(),
+// and *off to where they start in it. Returns the number of
+// bytes; 0 at end of file, or if empty and not wait; or -1 if
+// the caller has been killed.
+int
+pipetake(struct pipe *pi, int n, char **pa, uint *off, int wait)
+{
+  struct proc *pr = myproc();
+  struct pipebuf *b;
+
+  acquire(&pi->lock);
+  while(pi->nread == pi->nwrite && pi->writeopen && wait){
+    if(pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    waitdata(pi);
+  }
+  if(pi->nread == pi->nwrite){
+    release(&pi->lock);
+    return 0;
+  }
+  pipetrim(pi);
+  b = &pi->buf[pi->head % PIPEBUFS];
+  if(n > b->len)
+    n = b->len;
+  kdup(b->pa);
+  *pa = b->pa;
+  *off = b->off;
+  b->mine = 0;    // the caller is still using the bytes.
+  b->off += n;
+  b->len -= n;
+  pi->nread += n;
+  pipetrim(pi);
+  wakewriters(pi);
+  release(&pi->lock);
+  return n;
+}
+
+// Which of POLLIN, POLLHUP (read end) or POLLOUT, POLLERR
+// (write end) pi is ready for, for poll(). Also arranges for
+// pt to be woken when that changes, if pt isn't 0.
+int
+pipepoll(struct pipe *pi, int writable, struct polltable *pt)
+{
+  int r = 0;
+
+  acquire(&pi->lock);
+  if(writable){
+    pollwait(&pi->poll, pt, POLLOUT);
+    if(!pipefull(pi))
+      r |= POLLOUT;
+    if(!pi->readopen)
+      r |= POLLERR;
+  } else {
+    pollwait(&pi->poll, pt, POLLIN);
+    if(pi->nread != pi->nwrite)
+      r |= POLLIN;
+    if(!pi->writeopen)
+      r |= POLLHUP;
+  }
+  release(&pi->lock);
+  return r;
+}
+
+// The capacity of pi in bytes, for fcntl(F_GETPIPE_SZ).
+int
+pipesize(struct pipe *pi)
+{
+  return pi->nbufs * PGSIZE;
+}
+
+// Set the capacity of pi to at least n bytes, in whole pages,
+// for fcntl(F_SETPIPE_SZ). Returns the new capacity, or -1 if
+// n is too big or smaller than the data pi holds now.
+int
+pipesetsize(struct pipe *pi, int n)
+{
+  int nbufs;
+
+  if(n < 0 || n > PIPEBUFS*PGSIZE)
+    return -1;
+  nbufs = (n + PGSIZE - 1) / PGSIZE;
+  if(nbufs == 0)
+    nbufs = 1;
+  acquire(&pi->lock);
+  if(pi->tail - pi->head > nbufs){
+    release(&pi->lock);
+    return -1;
+  }
+  pi->nbufs = nbufs;
+  wakewriters(pi);
+  release(&pi->lock);
+  return nbufs * PGSIZE;
+}
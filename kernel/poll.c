@@ -0,0 +1,183 @@
+// poll(): wait until any of several files is ready.
+//
+// A pipe or the console has a pollhead, the list of poll()s
+// waiting for it to change. poll() asks each file whether it's
+// ready with filepoll(), which also puts an entry for the
+// poll() on the file's pollhead, under the same lock as the
+// check. If none is ready, poll() sleeps until a pollwake() on
+// one of the pollheads, or until its timeout.
+//
+// The sleeping poll() is on its hart's timer list while it has
+// a timeout, and sleeps under that hart's tmlock, so pollwake()
+// and the timer wake it the same way, with wakeup(&p->wakeat).
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
+#include "defs.h"
+
+// a file that a poll() is waiting for.
+struct pollent {
+  struct polltable *pt;
+  struct pollhead *h;
+  int events;                 // POLLIN and/or POLLOUT
+  struct pollent *next;       // on h's list
+};
+
+// a poll() in progress.
+struct polltable {
+  struct spinlock *lk;        // protects ready; poll() sleeps under it
+  int ready;                  // a pollwake() has happened
+  struct proc *p;
+  int n;                      // entries of ent[] in use
+  struct pollent ent[NPOLL];
+};
+
+void
+initpollhead(struct pollhead *h)
+{
+  initlock(&h->lock, "pollhead");
+  h->list = 0;
+}
+
+// Arrange for pt to be woken by a pollwake() of h for any of
+// events. Does nothing if pt is 0, i.e. the caller only wants
+// to know whether the file is ready now.
+// Caller must hold the lock that pollwake(h) is called under.
+void
+pollwait(struct pollhead *h, struct polltable *pt, int events)
+{
+  struct pollent *e;
+
+  if(pt == 0)
+    return;
+  if(pt->n >= NPOLL)
+    panic("pollwait");
+  e = &pt->ent[pt->n++];
+  e->pt = pt;
+  e->h = h;
+  e->events = events;
+  acquire(&h->lock);
+  e->next = h->list;
+  h->list = e;
+  release(&h->lock);
+}
+
+// Wake the poll()s waiting on h for any of events.
+// Caller must hold the lock that pollwait(h) is called under,
+// so that h->list can't miss a poll() that's about to sleep.
+void
+pollwake(struct pollhead *h, int events)
+{
+  struct pollent *e;
+
+  if(h->list == 0)
+    return;
+  acquire(&h->lock);
+  for(e = h->list; e; e = e->next){
+    if((e->events & events) == 0)
+      continue;
+    acquire(e->pt->lk);
+    e->pt->ready = 1;
+    wakeup(&e->pt->p->wakeat);
+    release(e->pt->lk);
+  }
+  release(&h->lock);
+}
+
+// Take pt's entries off their pollheads.
+static void
+pollfree(struct polltable *pt)
+{
+  struct pollent *e, **pe;
+  int i;
+
+  for(i = 0; i < pt->n; i++){
+    e = &pt->ent[i];
+    acquire(&e->h->lock);
+    for(pe = &e->h->list; *pe != e; pe = &(*pe)->next)
+      ;
+    *pe = e->next;
+    release(&e->h->lock);
+  }
+  pt->n = 0;
+}
+
+// Set fds[i].revents for each of the n files in f[], which
+// are 0 for fds that aren't open. Returns the number of fds
+// with any revents.
+static int
+pollscan(struct pollfd *fds, struct file **f, int n, struct polltable *pt)
+{
+  int i, nready = 0;
+
+  for(i = 0; i < n; i++){
+    if(fds[i].fd < 0)
+      fds[i].revents = 0;
+    else if(f[i] == 0)
+      fds[i].revents = POLLNVAL;
+    else
+      fds[i].revents = filepoll(f[i], fds[i].events, pt);
+    if(fds[i].revents)
+      nready++;
+  }
+  return nready;
+}
+
+// Wait until any of the n files in f[] is ready for the events
+// in the matching fds[], or for timeout ticks; forever if
+// timeout is negative. Sets each fds[i].revents. Returns the
+// number of ready fds, 0 on timeout, or -1 if killed.
+int
+poll(struct pollfd *fds, struct file **f, int n, int timeout)
+{
+  struct polltable pt;
+  struct proc *p = myproc();
+  struct cpu *c;
+  int nready;
+
+  pt.ready = 0;
+  pt.p = p;
+  pt.n = 0;
+
+  // stay on this hart until its timer is armed, since
+  // pollwake()s may use pt.lk as soon as pollscan() returns.
+  push_off();
+  c = mycpu();
+  pt.lk = &c->tmlock;
+  nready = pollscan(fds, f, n, timeout ? &pt : 0);
+  acquire(pt.lk);
+  pop_off();
+
+  if(nready == 0 && timeout > 0)
+    timeradd(c, r_time() + (uint64)timeout * TICKINTERVAL);
+  while(nready == 0 && timeout != 0){
+    if(p->killed){
+      nready = -1;
+      break;
+    }
+    if(timeout > 0 && p->wakeat == 0)
+      break;    // timed out
+    if(!pt.ready){
+      sleep(&p->wakeat, pt.lk);
+      continue;
+    }
+    pt.ready = 0;
+    release(pt.lk);
+    nready = pollscan(fds, f, n, 0);
+    acquire(pt.lk);
+  }
+  if(timeout > 0)
+    timerdel(c);
+  release(pt.lk);
+
+  pollfree(&pt);
+  return nready;
+}
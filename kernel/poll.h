@@ -0,0 +1,13 @@
+// Descriptors for poll().
+
+#define POLLIN   0x001    // can read without blocking
+#define POLLOUT  0x004    // can write without blocking
+#define POLLERR  0x008    // write end of a pipe with no readers
+#define POLLHUP  0x010    // read end of a pipe with no writers
+#define POLLNVAL 0x020    // fd isn't open
+
+struct pollfd {
+  int fd;                 // ignored if negative
+  short events;           // POLLIN and/or POLLOUT
+  short revents;          // set by poll(); may include POLLERR etc.
+};
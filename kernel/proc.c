@@ -4,6 +4,8 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "clock.h"
+#include "rusage.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
@@ -15,9 +17,35 @@ struct proc *initproc;
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// number of processes that are not UNUSED, other than
+// kernel threads.
+static int nactive;
+
+// Multi-level feedback scheduling. A process starts at its base
+// priority level and drops a level each time it uses up a time
+// slice, which is longer at lower levels. Waking up from sleep()
+// puts it back at its base level, so interactive and I/O-bound
+// processes stay ahead of CPU-bound ones. Every BOOSTTICKS ticks
+// all processes go back to their base levels, so that none
+// starves; boostgen counts these resets.
+#define SLICE(prio) (1 << (prio))
+static uint boostgen;
+
+// Sleeping processes, hashed by chan, so that wakeup() only
+// looks at processes that may be sleeping on its chan. A
+// process is on its queue, linked through p->wqnext, from
+// when it goes to sleep until it runs again.
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+};
+static struct waitq waitq[NWAITQ];
+
 extern void forkret(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static void runqput(struct proc *p);
+static void runqwake(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -45,8 +73,13 @@ procinit(void)
   struct proc *p;
   
   initlock(&pid_lock, "nextpid");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&cpus[i].rqlock, "runq");
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
+      initlock(&p->shlock, "shlock");
       p->kstack = KSTACK((int) (p - proc));
   }
 }
@@ -94,10 +127,12 @@ allocpid() {
 
 // Look in the process table for an UNUSED proc.
 // If found, initialize state required to run in the kernel,
-// and return with p->lock held.
+// and return with p->lock held. If leader isn't 0, the new
+// proc is a thread of leader's process and shares its page
+// table, else it gets a page table of its own.
 // If there are no free procs, or a memory allocation fails, return 0.
 static struct proc*
-allocproc(void)
+allocproc(struct proc *leader)
 {
   struct proc *p;
 
@@ -120,12 +155,44 @@ found:
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
-    freeproc(p);
-    release(&p->lock);
-    return 0;
+  if(leader == 0){
+    // An empty user page table.
+    p->leader = p;
+    p->ofile = p->ofile0;
+    p->nofile = NOFILE;
+    memset(p->ofile0, 0, sizeof(p->ofile0));
+    memset(p->fdbits, 0, sizeof(p->fdbits));
+    memset(&p->ru, 0, sizeof(p->ru));
+    memset(&p->cru, 0, sizeof(p->cru));
+    p->trapva = TRAPFRAME;
+    if((p->clock = (struct clockpage *)kalloc()) == 0){
+      freeproc(p);
+      release(&p->lock);
+      return 0;
+    }
+    clockpageinit(p->clock);
+    p->pagetable = proc_pagetable(p);
+    if(p->pagetable == 0){
+      freeproc(p);
+      release(&p->lock);
+      return 0;
+    }
+  } else {
+    // each thread's trapframe has its own page in the
+    // shared page table.
+    p->leader = leader;
+    p->trapva = THREADTRAPFRAME(p - proc);
+    acquire(&leader->shlock);
+    if(mappages(leader->pagetable, p->trapva, PGSIZE,
+                (uint64)(p->trapframe), PTE_R | PTE_W) < 0){
+      release(&leader->shlock);
+      freeproc(p);
+      release(&p->lock);
+      return 0;
+    }
+    p->pagetable = leader->pagetable;
+    p->sz = leader->sz;
+    release(&leader->shlock);
   }
 
   // Set up new context to start executing at forkret,
@@ -146,9 +213,25 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
+  if(p->leader == p && p->ofile != p->ofile0){
+    kfree((char *)p->ofile);
+    p->ofile = p->ofile0;
+    p->nofile = NOFILE;
+  }
+  if(p->leader == p && p->clock){
+    kfree((void*)p->clock);
+    p->clock = 0;
+  }
+  if(p->pagetable && p->leader != p){
+    // a thread: the page table belongs to the leader.
+    acquire(&p->leader->shlock);
+    uvmunmap(p->pagetable, p->trapva, 1, 0);
+    release(&p->leader->shlock);
+  } else if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
+  p->leader = 0;
+  p->ustack = 0;
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
@@ -156,6 +239,10 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->prio = p->baseprio = p->slice = 0;
+  if(p->state != UNUSED && !p->kthread)
+    __sync_fetch_and_add(&nactive, -1);
+  p->kthread = 0;
   p->state = UNUSED;
 }
 
@@ -189,6 +276,16 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the clock page below the rings, read-only for the
+  // process; the kernel writes it through its own mapping.
+  if(mappages(pagetable, CLOCKPAGE, PGSIZE,
+              (uint64)(p->clock), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -199,6 +296,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, CLOCKPAGE, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -220,7 +318,7 @@ userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
   
   // allocate one user page and copy init's instructions
@@ -235,7 +333,9 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  p->cpu = 0;
+  __sync_fetch_and_add(&nactive, 1);
+  runqput(p);
 
   release(&p->lock);
 }
@@ -246,20 +346,70 @@ int
 growproc(int n)
 {
   uint sz;
-  struct proc *p = myproc();
+  struct proc *p = myproc(), *lp = p->leader, *t;
 
-  sz = p->sz;
+  acquire(&lp->shlock);
+  sz = lp->sz;
   if(n > 0){
+    if(vmaoverlap(lp, PGROUNDUP(sz), PGROUNDUP(sz + n)) != 0){
+      release(&lp->shlock);
+      return -1;
+    }
     if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+      release(&lp->shlock);
       return -1;
     }
   } else if(n < 0){
+    // other threads may still be using the pages.
+    uvmrevoke(p->pagetable, PGROUNDUP(sz + n), (PGROUNDUP(sz) - PGROUNDUP(sz + n)) / PGSIZE);
+    tlbshootdown(lp);
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->sz = sz;
+  lp->sz = sz;
+  release(&lp->shlock);
+
+  // every thread has a copy of sz, which it reads without
+  // locks; copy the leader's, the latest even if another
+  // growproc() has run since.
+  for(t = proc; t < &proc[NPROC]; t++){
+    if(t == lp || t->leader != lp)
+      continue;
+    acquire(&t->lock);
+    if(t->leader == lp)
+      t->sz = __atomic_load_n(&lp->sz, __ATOMIC_RELAXED);
+    release(&t->lock);
+  }
   return 0;
 }
 
+// Wait until no hart can still use stale TLB entries for lp's
+// page table, after the caller has taken away user access to
+// pages (see uvmrevoke()) and before it frees them. A hart
+// flushes its TLB each time it enters the kernel from user
+// space, in uservec, so only a hart running a thread of lp in
+// user space may have stale entries: interrupt it, and wait
+// for it to trap. The caller may hold lp->shlock.
+void
+tlbshootdown(struct proc *lp)
+{
+  uint64 gen[NCPU];
+  struct proc *t;
+  int i;
+
+  __sync_synchronize();
+  for(i = 0; i < NCPU; i++){
+    gen[i] = __atomic_load_n(&cpus[i].ugen, __ATOMIC_ACQUIRE);
+    t = __atomic_load_n(&cpus[i].proc, __ATOMIC_RELAXED);
+    if((gen[i] & 1) && t && t->leader == lp)
+      *(uint32*)CLINT_MSIP(i) = 1;
+    else
+      gen[i] = 0;
+  }
+  for(i = 0; i < NCPU; i++)
+    while(gen[i] && __atomic_load_n(&cpus[i].ugen, __ATOMIC_ACQUIRE) == gen[i])
+      ;
+}
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int
@@ -267,20 +417,40 @@ fork(void)
 {
   int i, pid;
   struct proc *np;
-  struct proc *p = myproc();
+  struct proc *p = myproc(), *lp = p->leader;
 
   // Allocate process.
-  if((np = allocproc()) == 0){
+  if((np = allocproc(0)) == 0){
     return -1;
   }
 
+  // a grown descriptor table needs a page in the child too.
+  acquire(&lp->shlock);
+  if(lp->nofile > NOFILE){
+    if((np->ofile = (struct file **)kalloc()) == 0){
+      np->ofile = np->ofile0;
+      release(&lp->shlock);
+      freeproc(np);
+      release(&np->lock);
+      return -1;
+    }
+    np->nofile = lp->nofile;
+  }
+
   // Copy user memory from parent to child.
   if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+    release(&lp->shlock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
   np->sz = p->sz;
+  if(vmadup(np, lp) < 0){
+    release(&lp->shlock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
   np->parent = p;
 
@@ -290,17 +460,25 @@ fork(void)
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
-  // increment reference counts on open file descriptors.
-  for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+  // copy the descriptor table, growing the child's to match,
+  // and increment reference counts on open file descriptors.
+  for(i = 0; i < np->nofile; i++)
+    if((np->ofile[i] = lp->ofile[i]) != 0)
+      filedup(np->ofile[i]);
+  memmove(np->fdbits, lp->fdbits, sizeof(lp->fdbits));
+  np->cwd = idup(lp->cwd);
+  release(&lp->shlock);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
 
-  np->state = RUNNABLE;
+  np->cpu = cpuid();
+  np->baseprio = p->baseprio;
+  np->prio = np->baseprio;
+  np->slice = 0;
+  __sync_fetch_and_add(&nactive, 1);
+  runqput(np);
 
   release(&np->lock);
 
@@ -333,6 +511,26 @@ reparent(struct proc *p)
   }
 }
 
+// Pass the thread children of exiting thread p to the leader.
+static void
+giveleader(struct proc *p)
+{
+  struct proc *lp = p->leader, *pp;
+
+  acquire(&lp->lock);
+  for(pp = proc; pp < &proc[NPROC]; pp++){
+    // as in reparent(), only p changes pp->parent.
+    if(pp->parent == p && pp->leader == lp){
+      acquire(&pp->lock);
+      pp->parent = lp;
+      release(&pp->lock);
+    }
+  }
+  // the leader might be in join() or killthreads().
+  wakeup1(lp);
+  release(&lp->lock);
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait().
@@ -344,20 +542,35 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
+  // the leader takes the other threads down with it,
+  // and then releases what they shared.
+  if(p->leader == p){
+    ringstop(p);
+    killthreads(p);
+    ringfree(p);
+
+    // Close all open files.
+    for(int fd = 0; fd < p->nofile; fd++){
+      if(p->ofile[fd]){
+        struct file *f = p->ofile[fd];
+        fileclose(f);
+        p->ofile[fd] = 0;
+      }
     }
+    if(p->ofile != p->ofile0)
+      kfree((char *)p->ofile);
+    p->ofile = p->ofile0;
+    p->nofile = NOFILE;
+    memset(p->fdbits, 0, sizeof(p->fdbits));
+
+    vmafree(p->pagetable, p->vma);
+
+    begin_op();
+    iput(p->cwd);
+    end_op();
+    p->cwd = 0;
   }
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
-
   // we might re-parent a child to init. we can't be precise about
   // waking up init, since we can't acquire its lock once we've
   // acquired any other proc lock. so wake up init whether that's
@@ -367,21 +580,31 @@ exit(int status)
   wakeup1(initproc);
   release(&initproc->lock);
 
+  // a thread gives its thread children to the leader, which is
+  // an ancestor of every thread, so its lock comes first.
+  if(p->leader != p)
+    giveleader(p);
+
   // grab a copy of p->parent, to ensure that we unlock the same
-  // parent we locked. in case our parent gives us away to init while
-  // we're waiting for the parent lock. we may then race with an
-  // exiting parent, but the result will be a harmless spurious wakeup
-  // to a dead or wrong process; proc structs are never re-allocated
-  // as anything else.
-  acquire(&p->lock);
-  struct proc *original_parent = p->parent;
-  release(&p->lock);
+  // parent we locked. in case our parent gives us away to init,
+  // or to the leader, while we're waiting for the parent lock,
+  // try again: a thread's new parent may be waiting in join().
+  struct proc *original_parent;
+  for(;;){
+    acquire(&p->lock);
+    original_parent = p->parent;
+    release(&p->lock);
   
-  // we need the parent's lock in order to wake it up from wait().
-  // the parent-then-child rule says we have to lock it first.
-  acquire(&original_parent->lock);
+    // we need the parent's lock in order to wake it up from wait().
+    // the parent-then-child rule says we have to lock it first.
+    acquire(&original_parent->lock);
 
-  acquire(&p->lock);
+    acquire(&p->lock);
+    if(p->parent == original_parent)
+      break;
+    release(&p->lock);
+    release(&original_parent->lock);
+  }
 
   // Give any children to init.
   reparent(p);
@@ -399,14 +622,93 @@ exit(int status)
   panic("zombie exit");
 }
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
+// Charge the cycles since p->tstamp to its process's user
+// time, if user is set, or else to its system time.
+void
+chargetime(struct proc *p, int user)
+{
+  uint64 now = r_time();
+
+  __sync_fetch_and_add(user ? &p->leader->ru.utime : &p->leader->ru.stime,
+                       now - p->tstamp);
+  p->tstamp = now;
+}
+
+// Add usage u to *sum.
+static void
+usageadd(struct usage *sum, struct usage *u)
+{
+  uint64 *s = (uint64*)sum, *a = (uint64*)u;
+  int i;
+
+  for(i = 0; i < sizeof(*u) / sizeof(uint64); i++)
+    __sync_fetch_and_add(&s[i], a[i]);
+}
+
+// Copy the usage of leader lp to *u, taking the counters
+// that live in its clock page from there.
+static void
+usageof(struct proc *lp, struct usage *u)
+{
+  memset(u, 0, sizeof(*u));
+  usageadd(u, &lp->ru);
+  u->nvcsw = lp->clock->nvcsw;
+  u->nivcsw = lp->clock->nivcsw;
+  u->nfault = lp->clock->nfault;
+}
+
+// Convert u to the struct rusage that getrusage() reports.
+static void
+usagetorusage(struct usage *u, struct rusage *ru)
+{
+  ru->utime = u->utime / (TIMEBASE / 1000000);
+  ru->stime = u->stime / (TIMEBASE / 1000000);
+  ru->nvcsw = u->nvcsw;
+  ru->nivcsw = u->nivcsw;
+  ru->nfault = u->nfault;
+  ru->inblock = u->inblock;
+  ru->oublock = u->oublock;
+  ru->npages = u->npages;
+}
+
+// Copy the resource usage of the current process to user
+// address addr: its own if who is RUSAGE_SELF, or that of the
+// children it has waited for if who is RUSAGE_CHILDREN.
 int
-wait(uint64 addr)
+getrusage(int who, uint64 addr)
+{
+  struct proc *p = myproc();
+  struct usage u;
+  struct rusage ru;
+
+  if(who == RUSAGE_SELF){
+    usageof(p->leader, &u);
+    usagetorusage(&u, &ru);
+  } else if(who == RUSAGE_CHILDREN)
+    usagetorusage(&p->leader->cru, &ru);
+  else
+    return -1;
+  return copyout(p->pagetable, addr, (char*)&ru, sizeof(ru));
+}
+
+// Wait for a child to exit and return its pid.
+// Return -1 if this process has no children.
+// wait() waits for processes forked by the caller, and puts
+// the exit status at user address addr, and if ruaddr isn't
+// 0, the child's resource usage, with that of the children
+// it waited for, at ruaddr; join() waits for threads it
+// cloned, and puts the thread's stack at addr.
+static int
+reap(uint64 addr, uint64 ruaddr, int thread)
 {
   struct proc *np;
-  int havekids, pid;
+  int havekids, pid, n;
   struct proc *p = myproc();
+  struct usage u;
+  struct rusage ru;
+  char *src;
+
+  n = thread ? sizeof(np->ustack) : sizeof(np->xstate);
 
   // hold p->lock for the whole time to avoid lost
   // wakeups from a child's exit().
@@ -419,7 +721,14 @@ wait(uint64 addr)
       // this code uses np->parent without holding np->lock.
       // acquiring the lock first would cause a deadlock,
       // since np might be an ancestor, and we already hold p->lock.
-      if(np->parent == p){
+      if(np->parent == p && np->kthread && np->state == ZOMBIE){
+        // an exited kernel thread, such as the log's flusher.
+        // nobody waits for these, so free it in passing.
+        acquire(&np->lock);
+        if(np->state == ZOMBIE)
+          freeproc(np);
+        release(&np->lock);
+      } else if(np->parent == p && (np->leader != np) == thread && !np->kthread){
         // np->parent can't change between the check and the acquire()
         // because only the parent changes it, and we're the parent.
         acquire(&np->lock);
@@ -427,12 +736,24 @@ wait(uint64 addr)
         if(np->state == ZOMBIE){
           // Found one.
           pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
+          src = thread ? (char*)&np->ustack : (char*)&np->xstate;
+          if(addr != 0 && copyout(p->pagetable, addr, src, n) < 0) {
             release(&np->lock);
             release(&p->lock);
             return -1;
           }
+          if(!thread){
+            usageof(np, &u);
+            usageadd(&u, &np->cru);
+            usagetorusage(&u, &ru);
+            if(ruaddr != 0 &&
+               copyout(p->pagetable, ruaddr, (char*)&ru, sizeof(ru)) < 0){
+              release(&np->lock);
+              release(&p->lock);
+              return -1;
+            }
+            usageadd(&p->leader->cru, &u);
+          }
           freeproc(np);
           release(&np->lock);
           release(&p->lock);
@@ -453,10 +774,299 @@ wait(uint64 addr)
   }
 }
 
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
+wait(uint64 addr)
+{
+  return reap(addr, 0, 0);
+}
+
+// wait(), and put the child's resource usage at ruaddr.
+int
+wait2(uint64 addr, uint64 ruaddr)
+{
+  return reap(addr, ruaddr, 0);
+}
+
+// Wait for a thread that the caller created with clone()
+// to exit, and return its pid. Return -1 if there are none.
+int
+join(uint64 addr)
+{
+  return reap(addr, 0, 1);
+}
+
+// Create a thread of the current process, which shares its
+// memory, open files and current directory, and starts
+// executing fn(a0, a1) on the stack [stack, stack+stacksz).
+// Return the new thread's pid, or -1.
+int
+clone(uint64 fn, uint64 a0, uint64 a1, uint64 stack, uint64 stacksz)
+{
+  struct proc *np;
+  struct proc *p = myproc();
+  int pid;
+
+  if(stack % 16 || stacksz % 16 || stacksz == 0)
+    return -1;
+
+  if((np = allocproc(p->leader)) == 0)
+    return -1;
+  np->parent = p;
+  np->ustack = stack;
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = a0;
+  np->trapframe->a1 = a1;
+  np->trapframe->sp = stack + stacksz;
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  np->cpu = cpuid();
+  np->baseprio = p->baseprio;
+  np->prio = np->baseprio;
+  np->slice = 0;
+  __sync_fetch_and_add(&nactive, 1);
+  runqput(np);
+
+  release(&np->lock);
+
+  return pid;
+}
+
+// Start a thread of p's process that runs fn() in the kernel
+// and never returns to user space, such as a ring worker.
+// fn() starts out holding its p->lock, as forkret() does, and
+// must exit() when the process is killed. join() doesn't wait
+// for these; the leader frees them in wait() or killthreads().
+// Returns the new thread's pid, or -1.
+int
+kthread(struct proc *p, void (*fn)(void), char *name)
+{
+  struct proc *np;
+  int pid;
+
+  if((np = allocproc(p->leader)) == 0)
+    return -1;
+  np->parent = p->leader;
+  np->kthread = 1;
+  np->context.ra = (uint64)fn;
+  safestrcpy(np->name, name, sizeof(np->name));
+
+  pid = np->pid;
+
+  np->cpu = cpuid();
+  np->baseprio = p->baseprio;
+  np->prio = np->baseprio;
+  np->slice = 0;
+  runqput(np);
+
+  release(&np->lock);
+
+  return pid;
+}
+
+// Kill the other threads of p's process and wait until they
+// have all exited, for exit() and exec(). p must be the leader;
+// exit() gives it any thread whose parent has gone.
+void
+killthreads(struct proc *p)
+{
+  struct proc *t;
+  int n;
+
+  acquire(&p->lock);
+  for(;;){
+    n = 0;
+    for(t = proc; t < &proc[NPROC]; t++){
+      if(t == p || t->leader != p)
+        continue;
+      acquire(&t->lock);
+      if(t->leader != p){
+        // freed by a join() meanwhile.
+      } else if(t->state == ZOMBIE && t->parent == p){
+        freeproc(t);
+      } else if(t->state != UNUSED){
+        t->killed = 1;
+        if(t->state == SLEEPING)
+          runqwake(t);
+        n++;
+      }
+      release(&t->lock);
+    }
+    if(n == 0)
+      break;
+    sleep(p, &p->lock);
+  }
+  release(&p->lock);
+}
+
+// Put p back at its base priority level if all processes
+// have been boosted since it was last reset.
+// Caller must hold p->lock.
+static void
+checkboost(struct proc *p)
+{
+  uint gen = __atomic_load_n(&boostgen, __ATOMIC_RELAXED);
+
+  if(p->boost != gen){
+    p->boost = gen;
+    p->prio = p->baseprio;
+    p->slice = 0;
+  }
+}
+
+// Append p to the queue for its level on c.
+// Caller must hold c->rqlock.
+static void
+rqappend(struct cpu *c, struct proc *p)
+{
+  p->rqnext = 0;
+  if(c->rqtail[p->prio])
+    c->rqtail[p->prio]->rqnext = p;
+  else
+    c->rqhead[p->prio] = p;
+  c->rqtail[p->prio] = p;
+  c->rqlen++;
+}
+
+// Make p RUNNABLE and append it to the run queue of the cpu
+// it last ran on, which is likely to still have its state in
+// cache. Idle cpus steal from the queue if that cpu is busy.
+// Caller must hold p->lock.
+static void
+runqput(struct proc *p)
+{
+  struct cpu *c = &cpus[p->cpu];
+
+  if(!holding(&p->lock))
+    panic("runqput");
+  p->state = RUNNABLE;
+  checkboost(p);
+
+  acquire(&c->rqlock);
+  rqappend(c, p);
+  release(&c->rqlock);
+}
+
+// Wake p, which is SLEEPING, at its base priority level.
+// Caller must hold p->lock.
+static void
+runqwake(struct proc *p)
+{
+  p->prio = p->baseprio;
+  p->slice = 0;
+  runqput(p);
+}
+
+// Take the first process of the highest non-empty level
+// of c's run queue, or return 0.
+static struct proc*
+runqget(struct cpu *c)
+{
+  struct proc *p = 0;
+  int l;
+
+  // peek without the lock, so idle cpus polling
+  // empty queues don't bounce the lock around.
+  if(__atomic_load_n(&c->rqlen, __ATOMIC_RELAXED) == 0)
+    return 0;
+
+  acquire(&c->rqlock);
+  for(l = 0; l < NPRIO; l++){
+    if((p = c->rqhead[l]) != 0){
+      c->rqhead[l] = p->rqnext;
+      if(c->rqhead[l] == 0)
+        c->rqtail[l] = 0;
+      c->rqlen--;
+      p->rqnext = 0;
+      break;
+    }
+  }
+  release(&c->rqlock);
+  return p;
+}
+
+// Put every process back at its base priority level.
+// Called by clockintr() every BOOSTTICKS ticks. Processes
+// on run queues are moved now; the rest catch up in
+// checkboost() when they next run or queue. p->lock comes
+// before rqlock, so each queue is emptied first and its
+// processes are requeued one by one under their own locks.
+void
+schedboost(void)
+{
+  struct proc *p, *list, **tail;
+  struct cpu *c;
+  uint gen;
+  int l;
+
+  gen = __atomic_add_fetch(&boostgen, 1, __ATOMIC_RELAXED);
+
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    acquire(&c->rqlock);
+    // unhook all levels, highest first, then requeue.
+    list = 0;
+    tail = &list;
+    for(l = 0; l < NPRIO; l++){
+      if(c->rqhead[l]){
+        *tail = c->rqhead[l];
+        tail = &c->rqtail[l]->rqnext;
+      }
+      c->rqhead[l] = c->rqtail[l] = 0;
+    }
+    c->rqlen = 0;
+    release(&c->rqlock);
+
+    // off the queue, nothing else changes p until it's back.
+    while((p = list) != 0){
+      list = p->rqnext;
+      acquire(&p->lock);
+      p->boost = gen;
+      p->prio = p->baseprio;
+      p->slice = 0;
+      acquire(&c->rqlock);
+      rqappend(c, p);
+      release(&c->rqlock);
+      release(&p->lock);
+    }
+  }
+}
+
+// Choose a process for cpu id: the next one on its own run
+// queue, or else one stolen from the longest other queue.
+static struct proc*
+runqpick(int id)
+{
+  struct proc *p;
+  int i, n, len, victim;
+
+  if((p = runqget(&cpus[id])) != 0)
+    return p;
+
+  victim = -1;
+  n = 0;
+  for(i = 0; i < NCPU; i++){
+    len = __atomic_load_n(&cpus[i].rqlen, __ATOMIC_RELAXED);
+    if(i != id && len > n){
+      n = len;
+      victim = i;
+    }
+  }
+  if(victim < 0)
+    return 0;
+  return runqget(&cpus[victim]);
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - take a process off this CPU's run queue, or
+//    steal one from another CPU's.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -465,36 +1075,48 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
   
   c->proc = 0;
+  rcu_idle(0);
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
-    
-    int nproc = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state != UNUSED) {
-        nproc++;
-      }
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
+    rcu_qs();
+
+    if((p = runqpick(id)) == 0){
+      // idle: no scheduling ticks until there's work.
+      // keep passing quiescent states while RCU callbacks wait.
+      timerbusy(0);
+      if(__atomic_load_n(&nactive, __ATOMIC_RELAXED) <= 2 && !rcu_busy()){   // only init and sh exist
+        rcu_idle(1);
+        asm volatile("wfi");
+        rcu_idle(0);
       }
-      release(&p->lock);
-    }
-    if(nproc <= 2) {   // only init and sh exist
-      intr_on();
-      asm volatile("wfi");
+      continue;
     }
+    timerbusy(1);
+
+    // A process on a run queue stays RUNNABLE until a
+    // scheduler takes it off. It may still be on its way
+    // out of sched() on another cpu, holding p->lock.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler");
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->cpu = id;
+    c->proc = p;
+    p->tstamp = r_time();
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -520,6 +1142,11 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  if(p->state == SLEEPING)
+    __sync_fetch_and_add(&p->leader->clock->nvcsw, 1);
+  else if(p->state == RUNNABLE)
+    __sync_fetch_and_add(&p->leader->clock->nivcsw, 1);
+  chargetime(p, 0);
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
@@ -531,11 +1158,69 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  runqput(p);
   sched();
   release(&p->lock);
 }
 
+// Charge the current process for a timer tick. It gives up
+// the CPU if it has used up its time slice, which also drops
+// it a priority level, or if a process of higher priority
+// is waiting on this CPU.
+void
+schedtick(void)
+{
+  struct proc *p = myproc();
+  struct cpu *c = mycpu();
+  int l, preempt = 0;
+
+  rcu_qs();
+  acquire(&p->lock);
+  checkboost(p);
+  if(++p->slice >= SLICE(p->prio)){
+    if(p->prio < NPRIO-1)
+      p->prio++;
+    p->slice = 0;
+    preempt = 1;
+  }
+  for(l = 0; l < p->prio && !preempt; l++){
+    if(__atomic_load_n(&c->rqhead[l], __ATOMIC_RELAXED))
+      preempt = 1;
+  }
+  if(preempt){
+    runqput(p);
+    sched();
+  }
+  release(&p->lock);
+}
+
+// Set the base priority level of process pid; 0 is the
+// highest and NPRIO-1 the lowest.
+// Returns 0, or -1 if there's no such process or level.
+int
+setpriority(int pid, int prio)
+{
+  struct proc *p;
+
+  if(prio < 0 || prio >= NPRIO)
+    return -1;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      p->baseprio = prio;
+      // a queued process keeps its place for now.
+      if(p->state != RUNNABLE){
+        p->prio = prio;
+        p->slice = 0;
+      }
+      release(&p->lock);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -557,20 +1242,33 @@ forkret(void)
   usertrapret();
 }
 
+static struct waitq*
+waitqueue(void *chan)
+{
+  // Fibonacci hashing: the high bits of the product
+  // depend on all of chan's bits.
+  return &waitq[(((uint64)chan * 0x9E3779B97F4A7C15UL) >> 32) % NWAITQ];
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = 0;
+  struct proc **pp;
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
+  // p goes on chan's wait queue before lk is
+  // released, and wakeup locks the queue and
+  // then p->lock, so we can't miss a wakeup.
+  // wait() sleeps holding p->lock, and so can't
+  // lock the queue; it's woken by wakeup1 instead.
   if(lk != &p->lock){  //DOC: sleeplock0
+    wq = waitqueue(chan);
+    acquire(&wq->lock);
     acquire(&p->lock);  //DOC: sleeplock1
     release(lk);
   }
@@ -579,6 +1277,15 @@ sleep(void *chan, struct spinlock *lk)
   p->chan = chan;
   p->state = SLEEPING;
 
+  if(wq){
+    // append, so that wakeupone() is first come, first served.
+    for(pp = &wq->head; *pp; pp = &(*pp)->wqnext)
+      ;
+    p->wqnext = 0;
+    *pp = p;
+    release(&wq->lock);
+  }
+
   sched();
 
   // Tidy up.
@@ -587,24 +1294,66 @@ sleep(void *chan, struct spinlock *lk)
   // Reacquire original lock.
   if(lk != &p->lock){
     release(&p->lock);
+
+    // leave the wait queue; wakeup() doesn't take us off,
+    // since it would need the queue lock and p->lock in
+    // the opposite order to ours.
+    acquire(&wq->lock);
+    for(pp = &wq->head; *pp != p; pp = &(*pp)->wqnext)
+      ;
+    *pp = p->wqnext;
+    release(&wq->lock);
+
     acquire(lk);
   }
 }
 
-// Wake up all processes sleeping on chan.
-// Must be called without any p->lock.
-void
-wakeup(void *chan)
+// Wake up to max processes sleeping on chan, in the
+// order they went to sleep, or all of them if max is 0.
+// Returns the number woken.
+int
+wakeupn(void *chan, int max)
 {
+  struct waitq *wq = waitqueue(chan);
   struct proc *p;
-
-  for(p = proc; p < &proc[NPROC]; p++) {
+  int n = 0;
+
+  acquire(&wq->lock);
+  for(p = wq->head; p; p = p->wqnext){
+    // p->chan only changes to or from chan while p is on
+    // the queue, so a different chan means we can skip p
+    // without taking its lock.
+    if(p->chan != chan)
+      continue;
     acquire(&p->lock);
     if(p->state == SLEEPING && p->chan == chan) {
-      p->state = RUNNABLE;
+      runqwake(p);
+      n++;
     }
     release(&p->lock);
+    if(max && n >= max)
+      break;
   }
+  release(&wq->lock);
+  return n;
+}
+
+// Wake up all processes sleeping on chan.
+// Must be called without any p->lock.
+void
+wakeup(void *chan)
+{
+  wakeupn(chan, 0);
+}
+
+// Wake up the process that has slept longest on chan,
+// for sleepers that would otherwise all wake up only
+// for one of them to win, as for a sleeplock.
+// Must be called without any p->lock.
+void
+wakeupone(void *chan)
+{
+  wakeupn(chan, 1);
 }
 
 // Wake up p if it is sleeping in wait(); used by exit().
@@ -615,7 +1364,7 @@ wakeup1(struct proc *p)
   if(!holding(&p->lock))
     panic("wakeup1");
   if(p->chan == p && p->state == SLEEPING) {
-    p->state = RUNNABLE;
+    runqwake(p);
   }
 }
 
@@ -633,7 +1382,7 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        runqwake(p);
       }
       release(&p->lock);
       return 0;
@@ -700,4 +1449,8 @@ procdump(void)
     printf("%d %s %s", p->pid, state, p->name);
     printf("\n");
   }
+  for(int i = 0; i < NCPU; i++){
+    if(cpus[i].ntimer)
+      printf("cpu%d: %d timer interrupts\n", i, cpus[i].ntimer);
+  }
 }
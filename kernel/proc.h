@@ -24,6 +24,33 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+
+  // RUNNABLE processes waiting for this cpu, one FIFO queue
+  // per priority level, linked through p->rqnext.
+  // rqlock protects the queues.
+  struct spinlock rqlock;
+  struct proc *rqhead[NPRIO];
+  struct proc *rqtail[NPRIO];
+  int rqlen;                  // processes on all levels
+
+  // deadline timers; see timer.c. tmlock protects them.
+  struct spinlock tmlock;
+  struct proc *tmhead;        // processes in sleep(n), soonest first
+  int busy;                   // running processes, so taking ticks?
+  uint64 nexttick;            // time of the next scheduling tick
+  uint64 nextsample;          // time of the next profiling sample
+  uint64 armed;               // what the CLINT timer is set to
+  uint ntimer;                // timer interrupts taken
+  uint64 ugen;                // odd while in user space; see tlbshootdown()
+
+  // quiescent states for RCU; see rcu.c.
+  uint64 rcuqs;               // times this cpu was outside read sections
+  int rcuidle;                // waiting for an interrupt?
+
+  // free struct files; see filealloc(). Only this cpu uses
+  // them, with interrupts off.
+  struct file *ffree;
+  int nffree;
 };
 
 extern struct cpu cpus[NCPU];
@@ -80,6 +107,36 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// A region of user memory whose pages are filled in on the first
+// page fault, rather than when the region is set up. exec() makes
+// one for each loadable program segment.
+struct vma {
+  int used;
+  uint64 start;                // page-aligned first address
+  uint64 end;                  // page-aligned end address (exclusive)
+  int perm;                    // PTE_R, PTE_W, PTE_X
+  struct inode *ip;            // backing file, or 0 for zero-fill
+  uint off;                    // file offset of start
+  uint filesz;                 // bytes of file after off; the rest is zero
+  int flags;                   // MAP_* for mmap() regions, 0 for exec()'s
+};
+
+// Resources a process has used, for getrusage(), which
+// reports them as a struct rusage. Its threads add to these
+// with atomic instructions, so no lock is needed. A live
+// process counts nvcsw, nivcsw and nfault in its clock page
+// instead; see usageof().
+struct usage {
+  uint64 utime;                // time CSR cycles in user mode
+  uint64 stime;                // cycles in the kernel
+  uint64 nvcsw;                // sched() while SLEEPING
+  uint64 nivcsw;               // sched() while RUNNABLE
+  uint64 nfault;               // vmafault()s from usertrap()
+  uint64 inblock;              // bread()s that went to the disk
+  uint64 oublock;              // log_write()s
+  uint64 npages;               // kalloc()s
+};
+
 enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -93,14 +150,43 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // Run queue to join when RUNNABLE
+  int prio;                    // Priority level, 0 runs first
+  int baseprio;                // Level set by setpriority(); prio >= baseprio
+  int slice;                   // Ticks used at this level
+  uint boost;                  // boostgen when prio was last reset
+  uint64 wakeat;               // sleep(n) deadline, under cpus[].tmlock
+  struct proc *tmnext;         // Timer list link, under the same lock
+  struct proc *rqnext;         // Run queue link, under cpus[cpu].rqlock
+  struct proc *wqnext;         // Wait queue link, under its waitq's lock
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
+  uint64 sz;                   // Size of process memory (bytes); see growproc()
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
+  uint64 trapva;               // User address of trapframe
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
+  struct proc *leader;         // First thread of the process; p if not a thread
+  struct sleeplock *shared[NSHARED]; // Sleeplocks held shared
+  int nsleep;                  // Sleeplocks held, exclusive or shared
+  uint64 ustack;               // clone()'s stack, for join()
+  int kthread;                 // Never returns to user space; see kthread()
+  uint64 tstamp;               // r_time() when cpu time was last charged
+
+  // the threads of a process share these, in its leader,
+  // under the leader's shlock.
+  struct spinlock shlock;
+  struct file **ofile;         // Open files: ofile0, or a page of NOFILEMAX
+  int nofile;                  // Slots in ofile
+  uint64 fdbits[NOFILEMAX/64]; // Bit fd set while fd is in use
+  struct file *ofile0[NOFILE]; // A new process's slots
+  struct vma vma[NVMA];        // Demand-paged regions
+  int nfault;                  // vmafault()s filling pages outside shlock
   struct inode *cwd;           // Current directory
+  struct kring *ring;          // ringsetup()'s ring, or 0
+  struct clockpage *clock;     // Mapped at CLOCKPAGE; counters are atomic
+  struct usage ru;             // Used by all the threads
+  struct usage cru;            // Used by children that were waited for
   char name[16];               // Process name (debugging)
 };
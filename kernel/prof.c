@@ -0,0 +1,134 @@
+// Sampling profiler.
+//
+// While profstart() has it on, each busy hart's timer also
+// fires every profinterval cycles, and timerintr() calls
+// profsample() to note where the hart was: the pc that the
+// interrupt came from, in sepc, whether that was in user mode,
+// and the process running. Each hart puts its samples in its
+// own ring, and profread() moves them to user space; a sample
+// that finds its ring full is counted as lost instead.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "prof.h"
+#include "defs.h"
+
+uint64 profinterval;          // cycles between samples, or 0 if off
+struct spinlock startlock;    // serializes profstart()
+
+struct {
+  struct spinlock lock;
+  uint head;                  // next sample goes at buf[head % NPROFBUF]
+  uint tail;                  // oldest sample not yet read
+  uint64 nlost;
+  struct profsample buf[NPROFBUF];
+} profbuf[NCPU];
+
+void
+profinit(void)
+{
+  initlock(&startlock, "profstart");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&profbuf[i].lock, "prof");
+}
+
+// Record where this hart was when its timer interrupted it.
+// Called from timerintr(), in usertrap() or kerneltrap(),
+// with sepc and sstatus as the trap left them.
+void
+profsample(void)
+{
+  int id = cpuid();
+  struct proc *p = myproc();
+  struct profsample *s;
+
+  acquire(&profbuf[id].lock);
+  if(profbuf[id].head - profbuf[id].tail == NPROFBUF){
+    profbuf[id].nlost++;
+  } else {
+    s = &profbuf[id].buf[profbuf[id].head++ % NPROFBUF];
+    s->pc = r_sepc();
+    s->user = (r_sstatus() & SSTATUS_SPP) == 0;
+    s->cpu = id;
+    if(p){
+      s->pid = p->pid;
+      safestrcpy(s->name, p->name, sizeof(s->name));
+    } else {
+      s->pid = 0;
+      s->name[0] = 0;
+    }
+  }
+  release(&profbuf[id].lock);
+}
+
+// Discard old samples and start taking rate samples per
+// second on each busy hart. Returns 0, or -1 if rate is
+// out of range or the profiler is already on.
+int
+profstart(int rate)
+{
+  if(rate <= 0 || rate > TIMEBASE / 1000)
+    return -1;
+  acquire(&startlock);
+  if(profinterval){
+    release(&startlock);
+    return -1;
+  }
+  for(int i = 0; i < NCPU; i++){
+    acquire(&profbuf[i].lock);
+    profbuf[i].head = profbuf[i].tail = 0;
+    profbuf[i].nlost = 0;
+    release(&profbuf[i].lock);
+  }
+  __atomic_store_n(&profinterval, TIMEBASE / rate, __ATOMIC_RELAXED);
+  release(&startlock);
+  return 0;
+}
+
+// Stop taking samples. The ones not yet read stay for
+// profread(). Returns the number of samples lost since
+// profstart() because a hart's ring was full.
+uint64
+profstop(void)
+{
+  uint64 n = 0;
+
+  __atomic_store_n(&profinterval, 0, __ATOMIC_RELAXED);
+  for(int i = 0; i < NCPU; i++){
+    acquire(&profbuf[i].lock);
+    n += profbuf[i].nlost;
+    release(&profbuf[i].lock);
+  }
+  return n;
+}
+
+// Move up to n samples, from all harts, to the array at user
+// address addr. Returns how many it moved, or -1.
+int
+profread(uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct profsample s[16];
+  int i, k, got = 0;
+
+  for(i = 0; i < NCPU && got < n; i++){
+    for(;;){
+      // copyout() can't be under the lock; move a few at a time.
+      acquire(&profbuf[i].lock);
+      for(k = 0; k < NELEM(s) && got + k < n &&
+                 profbuf[i].tail != profbuf[i].head; k++)
+        s[k] = profbuf[i].buf[profbuf[i].tail++ % NPROFBUF];
+      release(&profbuf[i].lock);
+      if(k == 0)
+        break;
+      if(copyout(p->pagetable, addr + got * sizeof(s[0]), (char*)s, k * sizeof(s[0])) < 0)
+        return -1;
+      got += k;
+    }
+  }
+  return got;
+}
@@ -0,0 +1,12 @@
+// Samples taken by the profiler; see prof.c.
+
+#define PROFRATE 1000     // default samples per second per busy cpu
+
+struct profsample {
+  uint64 pc;              // where the cpu was
+  int pid;                // process running, or 0 for the scheduler
+  char user;              // 1 if pc is a user address, 0 if kernel
+  char cpu;
+  char pad[2];
+  char name[16];          // the process's name, i.e. its program
+};
@@ -0,0 +1,394 @@
+// Epoch-based deferred reclamation ("RCU-lite").
+//
+// Readers take no locks. rcu_read_lock() only turns off
+// interrupts, so a reader can't be preempted, and can't sleep
+// (sched() would panic), until rcu_read_unlock(). A cpu thus
+// holds nothing from a read section whenever it is in
+// scheduler(), takes a timer tick in schedtick(), or is idle;
+// those places call rcu_qs(), which counts a quiescent state
+// in c->rcuqs. An idle cpu that takes an interrupt counts as
+// busy until kerneltrap() is done with it.
+//
+// A grace period starts by noting every cpu's count, and ends
+// once each cpu has moved past it or is idle. Callbacks given
+// to call_rcu() before a grace period starts are run after it
+// ends, by whichever cpu notices. They run without a process,
+// sometimes from a timer interrupt, so they must not sleep.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "rcu.h"
+
+struct {
+  struct spinlock lock;
+  int pending;              // callbacks waiting; read without the lock
+  int busy;                 // a grace period is in progress
+  uint64 snap[NCPU];        // cpus[].rcuqs when it started
+  struct rcuhead *cur;      // callbacks waiting for it to end
+  struct rcuhead *next;     // callbacks waiting for the next one
+} rcu;
+
+void
+rcuinit(void)
+{
+  initlock(&rcu.lock, "rcu");
+  // a cpu counts as idle until it starts scheduling.
+  for(int i = 0; i < NCPU; i++)
+    cpus[i].rcuidle = 1;
+}
+
+void
+rcu_read_lock(void)
+{
+  push_off();
+}
+
+void
+rcu_read_unlock(void)
+{
+  pop_off();
+}
+
+// Has every cpu passed a quiescent state since rcu.snap?
+static int
+gpdone(void)
+{
+  for(int i = 0; i < NCPU; i++){
+    if(__atomic_load_n(&cpus[i].rcuidle, __ATOMIC_ACQUIRE))
+      continue;
+    if(__atomic_load_n(&cpus[i].rcuqs, __ATOMIC_ACQUIRE) == rcu.snap[i])
+      return 0;
+  }
+  return 1;
+}
+
+// End the current grace period if it's over, start the next
+// one if callbacks are waiting for it, and run the callbacks
+// whose grace period has ended.
+static void
+rcuadvance(void)
+{
+  struct rcuhead *done = 0, *h;
+
+  acquire(&rcu.lock);
+  if(rcu.busy && gpdone()){
+    done = rcu.cur;
+    rcu.cur = 0;
+    rcu.busy = 0;
+  }
+  if(!rcu.busy && rcu.next){
+    rcu.cur = rcu.next;
+    rcu.next = 0;
+    // the callers unpublished these objects before call_rcu();
+    // readers that started after that can't find them.
+    __sync_synchronize();
+    for(int i = 0; i < NCPU; i++)
+      rcu.snap[i] = __atomic_load_n(&cpus[i].rcuqs, __ATOMIC_ACQUIRE);
+    rcu.busy = 1;
+  }
+  __atomic_store_n(&rcu.pending, rcu.busy, __ATOMIC_RELEASE);
+  release(&rcu.lock);
+
+  while((h = done) != 0){
+    done = h->next;
+    h->fn(h);
+  }
+}
+
+// Note that this cpu is outside any read section.
+void
+rcu_qs(void)
+{
+  struct cpu *c;
+
+  push_off();
+  c = mycpu();
+  // release: this cpu's earlier read sections are over.
+  __atomic_store_n(&c->rcuqs, c->rcuqs + 1, __ATOMIC_RELEASE);
+  pop_off();
+
+  if(__atomic_load_n(&rcu.pending, __ATOMIC_ACQUIRE))
+    rcuadvance();
+}
+
+// Mark this cpu idle (1) before it waits for an interrupt,
+// so grace periods needn't wait for it, and busy (0) again
+// before it can enter a read section.
+void
+rcu_idle(int idle)
+{
+  struct cpu *c;
+
+  push_off();
+  c = mycpu();
+  __atomic_store_n(&c->rcuqs, c->rcuqs + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&c->rcuidle, idle, __ATOMIC_RELEASE);
+  // a grace period that missed this store can't have
+  // started after this cpu's next read section loads.
+  __sync_synchronize();
+  pop_off();
+}
+
+// Are callbacks waiting for a grace period? scheduler() keeps
+// counting quiescent states, rather than idling, until not.
+int
+rcu_busy(void)
+{
+  return __atomic_load_n(&rcu.pending, __ATOMIC_ACQUIRE);
+}
+
+// Call fn(h) once every read section that might have seen
+// the object containing h has finished.
+void
+call_rcu(struct rcuhead *h, void (*fn)(struct rcuhead *))
+{
+  h->fn = fn;
+  acquire(&rcu.lock);
+  h->next = rcu.next;
+  rcu.next = h;
+  __atomic_store_n(&rcu.pending, 1, __ATOMIC_RELEASE);
+  release(&rcu.lock);
+}
+
+struct rcusync {
+  struct rcuhead h;
+  int done;
+};
+
+static void
+syncdone(struct rcuhead *h)
+{
+  struct rcusync *s = (struct rcusync *)h;
+
+  acquire(&rcu.lock);
+  __atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+  wakeup(s);
+  release(&rcu.lock);
+}
+
+// Wait until every read section that was in progress has
+// finished. Without a process (at boot), spin instead of
+// sleeping.
+void
+synchronize_rcu(void)
+{
+  struct rcusync s;
+
+  s.done = 0;
+  call_rcu(&s.h, syncdone);
+
+  if(myproc() == 0){
+    while(__atomic_load_n(&s.done, __ATOMIC_ACQUIRE) == 0)
+      rcu_qs();
+    return;
+  }
+  acquire(&rcu.lock);
+  while(s.done == 0)
+    sleep(&s, &rcu.lock);
+  release(&rcu.lock);
+}
+
+#ifdef RCUTEST
+// Self-test and read-side benchmark, run by every hart at
+// boot; build with make RCUTEST=1. Hart 0 keeps replacing
+// rtcur while the other harts read it, first under RCU and
+// then under a spinlock, and each reader checks that it
+// never sees an object that has been freed.
+#define RTUPDATES 20000
+#define RTMAXOUT 64       // replaced objects not yet freed
+#define RTITERS 1000000
+#define RTLIVE 0x11ee
+
+enum { RTWAIT, RTRCU, RTLOCK, RTDONE };
+
+struct rtobj {
+  struct rcuhead rcu;
+  int magic;
+  int gen;
+  int v[16];              // all equal to gen
+};
+
+static struct rtobj *rtcur;
+static struct spinlock rtlock;
+static int rtphase, rtjoined, rtleft, rtout, rterrs, rtgen;
+static uint64 rtreads[RTDONE];
+
+static void
+rtcheck(struct rtobj *o, int *last)
+{
+  int bad = 0;
+
+  if(o == 0)
+    return;
+  if(o->magic != RTLIVE || o->gen < *last)
+    bad = 1;
+  for(int i = 0; i < NELEM(o->v); i++)
+    if(o->v[i] != o->gen)
+      bad = 1;
+  if(bad)
+    __atomic_fetch_add(&rterrs, 1, __ATOMIC_RELAXED);
+  *last = o->gen;
+}
+
+static struct rtobj *
+rtnew(void)
+{
+  struct rtobj *o;
+
+  if((o = (struct rtobj *)kalloc()) == 0)
+    panic("rcutest: kalloc");
+  o->gen = rtgen++;
+  for(int i = 0; i < NELEM(o->v); i++)
+    o->v[i] = o->gen;
+  o->magic = RTLIVE;
+  return o;
+}
+
+static void
+rtfree(struct rcuhead *h)
+{
+  struct rtobj *o = (struct rtobj *)h;
+
+  o->magic = 0;
+  kfree(o);
+  __atomic_fetch_sub(&rtout, 1, __ATOMIC_RELAXED);
+}
+
+static void
+rtread(void)
+{
+  uint64 n[RTDONE] = { 0 };
+  int ph, last = 0;
+
+  __atomic_fetch_add(&rtjoined, 1, __ATOMIC_SEQ_CST);
+  rcu_idle(0);
+  while((ph = __atomic_load_n(&rtphase, __ATOMIC_ACQUIRE)) != RTDONE){
+    if(ph == RTRCU){
+      rcu_read_lock();
+      rtcheck(rcu_dereference(rtcur), &last);
+      rcu_read_unlock();
+    } else if(ph == RTLOCK){
+      acquire(&rtlock);
+      rtcheck(rtcur, &last);
+      release(&rtlock);
+    }
+    n[ph]++;
+    rcu_qs();
+  }
+  for(ph = 0; ph < RTDONE; ph++)
+    __atomic_fetch_add(&rtreads[ph], n[ph], __ATOMIC_RELAXED);
+  rcu_idle(1);
+  __atomic_fetch_add(&rtleft, 1, __ATOMIC_SEQ_CST);
+}
+
+static void
+rtupdate(int ph, char *what)
+{
+  struct rtobj *o, *n;
+  uint64 t0, t1;
+
+  __atomic_store_n(&rtphase, ph, __ATOMIC_RELEASE);
+  // readers that saw the last phase must be done with it.
+  synchronize_rcu();
+
+  t0 = r_time();
+  for(int i = 0; i < RTUPDATES; i++){
+    n = rtnew();
+    if(ph == RTRCU){
+      while(__atomic_load_n(&rtout, __ATOMIC_RELAXED) >= RTMAXOUT)
+        rcu_qs();
+      o = rtcur;
+      rcu_assign_pointer(rtcur, n);
+      if(o){
+        __atomic_fetch_add(&rtout, 1, __ATOMIC_RELAXED);
+        call_rcu(&o->rcu, rtfree);
+      }
+      rcu_qs();
+    } else {
+      acquire(&rtlock);
+      o = rtcur;
+      rtcur = n;
+      release(&rtlock);
+      if(o)
+        kfree(o);
+    }
+  }
+  while(__atomic_load_n(&rtout, __ATOMIC_RELAXED) > 0)
+    rcu_qs();
+  t1 = r_time();
+  if(t1 == t0)
+    t1++;
+  printf("rcutest: %s: %d updates/s\n", what, (int)(RTUPDATES * TIMEBASE / (t1 - t0)));
+}
+
+// Print the cost of one read section of each kind, with no
+// other cpu looking.
+static void
+rtbench(void)
+{
+  struct rtobj *o = rtnew();
+  uint64 t0, t1, sum = 0;
+
+  rtcur = o;
+  t0 = r_time();
+  for(int i = 0; i < RTITERS; i++){
+    rcu_read_lock();
+    sum += rcu_dereference(rtcur)->gen;
+    rcu_read_unlock();
+  }
+  t1 = r_time();
+  printf("rcutest: rcu read %d ns\n", (int)((t1 - t0) * 1000000000 / TIMEBASE / RTITERS));
+
+  t0 = r_time();
+  for(int i = 0; i < RTITERS; i++){
+    acquire(&rtlock);
+    sum += rtcur->gen;
+    release(&rtlock);
+  }
+  t1 = r_time();
+  printf("rcutest: spinlock read %d ns\n", (int)((t1 - t0) * 1000000000 / TIMEBASE / RTITERS));
+
+  if(sum == 1)  // keep the reads from being optimized away.
+    printf("rcutest: sum %p\n", sum);
+  rtcur = 0;
+  kfree(o);
+}
+
+void
+rcutest(void)
+{
+  uint64 t0;
+
+  if(cpuid() != 0){
+    rtread();
+    return;
+  }
+
+  initlock(&rtlock, "rtlock");
+  rcu_idle(0);
+  // give the other harts time to get here.
+  t0 = r_time();
+  while(r_time() - t0 < TIMEBASE / 10)
+    ;
+  printf("rcutest: %d readers\n", __atomic_load_n(&rtjoined, __ATOMIC_SEQ_CST));
+
+  rtupdate(RTRCU, "rcu");
+  rtupdate(RTLOCK, "spinlock");
+  __atomic_store_n(&rtphase, RTDONE, __ATOMIC_RELEASE);
+  while(__atomic_load_n(&rtleft, __ATOMIC_SEQ_CST) != __atomic_load_n(&rtjoined, __ATOMIC_SEQ_CST))
+    ;
+  printf("rcutest: reads: rcu %d, spinlock %d\n", (int)rtreads[RTRCU], (int)rtreads[RTLOCK]);
+  if(rterrs)
+    panic("rcutest: reader saw a freed object");
+  kfree(rtcur);
+  rtcur = 0;
+
+  rtbench();
+  rcu_idle(1);
+}
+#endif
@@ -0,0 +1,15 @@
+// Read-copy-update; see rcu.c.
+//
+// A reader brackets its use of a shared pointer with
+// rcu_read_lock()/rcu_read_unlock() and loads it with
+// rcu_dereference(). An updater publishes a new version with
+// rcu_assign_pointer() and hands the old one to call_rcu(),
+// which calls fn once no reader can still be using it.
+
+struct rcuhead {
+  struct rcuhead *next;
+  void (*fn)(struct rcuhead *);
+};
+
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
@@ -0,0 +1,190 @@
+// Asynchronous file system calls through shared rings.
+//
+// ringsetup() maps a page holding a struct ring (see ring.h)
+// at RING in the process, and starts worker threads: threads
+// of the process that never leave the kernel, so they share
+// its page table and open files. ringenter() copies new
+// submissions into the kernel's own queue, wakes workers to
+// carry them out with ringop(), and waits for completions.
+// Every request thus costs one trap per batch, not one each,
+// and a slow one doesn't hold up the others.
+//
+// The process can write the shared page at any time, so the
+// kernel reads each sqe and index from it once, and relies
+// only on its own copies in struct kring.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "ring.h"
+
+struct kring {
+  struct spinlock lock;
+  struct ring *u;         // the shared page
+  uint sqhead;            // next sqe to take from u
+  uint cqtail;            // next cqe to fill in u
+  uint nsubmit;           // sqes taken so far
+  int stop;               // workers should exit
+  uint head, tail;        // requests waiting for a worker: q[head..tail)
+  struct sqe q[RINGSIZE];
+};
+
+static void
+ringworker(void)
+{
+  struct proc *p = myproc();
+  struct kring *r = p->leader->ring;
+  struct sqe e;
+  struct cqe c;
+
+  // still holding p->lock from scheduler, as in forkret().
+  release(&p->lock);
+
+  acquire(&r->lock);
+  for(;;){
+    while(r->head == r->tail && !r->stop && !p->killed)
+      sleep(&r->head, &r->lock);
+    if(r->stop || p->killed)
+      break;
+    e = r->q[r->head++ % RINGSIZE];
+    release(&r->lock);
+
+    c.data = e.data;
+    c.res = ringop(&e);
+    c.pad = 0;
+
+    acquire(&r->lock);
+    r->u->cq[r->cqtail++ % RINGSIZE] = c;
+    __atomic_store_n(&r->u->cqtail, r->cqtail, __ATOMIC_RELEASE);
+    wakeup(&r->cqtail);
+  }
+  release(&r->lock);
+  exit(0);
+}
+
+// Give the process a ring served by nworker worker threads.
+// Returns the ring's user address, or -1.
+uint64
+ringsetup(int nworker)
+{
+  struct proc *lp = myproc()->leader;
+  struct kring *r;
+  char *u;
+  int i;
+
+  if(nworker < 1 || nworker > NRINGWORKER)
+    return -1;
+  if((r = (struct kring*)kalloc()) == 0)
+    return -1;
+  if((u = kalloc()) == 0){
+    kfree(r);
+    return -1;
+  }
+  memset(r, 0, sizeof(*r));
+  memset(u, 0, PGSIZE);
+  initlock(&r->lock, "ring");
+  r->u = (struct ring*)u;
+
+  acquire(&lp->shlock);
+  if(lp->ring || mappages(lp->pagetable, RING, PGSIZE, (uint64)u,
+                          PTE_R | PTE_W | PTE_U) < 0){
+    release(&lp->shlock);
+    freelock(&r->lock);
+    kfree(u);
+    kfree(r);
+    return -1;
+  }
+  lp->ring = r;
+  release(&lp->shlock);
+
+  for(i = 0; i < nworker; i++)
+    if(kthread(lp, ringworker, "ringworker") < 0)
+      break;
+  if(i == 0){
+    acquire(&lp->shlock);
+    lp->ring = 0;
+    uvmrevoke(lp->pagetable, RING, 1);
+    tlbshootdown(lp);
+    uvmunmap(lp->pagetable, RING, 1, 1);
+    release(&lp->shlock);
+    freelock(&r->lock);
+    kfree(r);
+    return -1;
+  }
+  return RING;
+}
+
+// Submit up to n new sqes, then wait until at least minwait
+// cqes are ready to be reaped. Returns the number submitted,
+// or -1.
+int
+ringenter(int n, int minwait)
+{
+  struct proc *p = myproc();
+  struct kring *r = p->leader->ring;
+  uint sqtail, cqhead;
+  int i;
+
+  if(r == 0)
+    return -1;
+
+  acquire(&r->lock);
+  sqtail = __atomic_load_n(&r->u->sqtail, __ATOMIC_ACQUIRE);
+  for(i = 0; i < n && r->sqhead != sqtail; i++){
+    // leave room in cq for everything submitted.
+    cqhead = __atomic_load_n(&r->u->cqhead, __ATOMIC_RELAXED);
+    if(r->nsubmit - cqhead >= RINGSIZE)
+      break;
+    r->q[r->tail++ % RINGSIZE] = r->u->sq[r->sqhead++ % RINGSIZE];
+    r->nsubmit++;
+  }
+  __atomic_store_n(&r->u->sqhead, r->sqhead, __ATOMIC_RELEASE);
+  if(i > 0)
+    wakeupn(&r->head, i);
+
+  for(;;){
+    cqhead = __atomic_load_n(&r->u->cqhead, __ATOMIC_RELAXED);
+    // don't wait for more than is outstanding.
+    if(r->cqtail - cqhead >= minwait || r->nsubmit - cqhead < minwait)
+      break;
+    if(p->killed){
+      release(&r->lock);
+      return -1;
+    }
+    sleep(&r->cqtail, &r->lock);
+  }
+  release(&r->lock);
+  return i;
+}
+
+// Tell p's ring workers to exit, before killthreads().
+void
+ringstop(struct proc *p)
+{
+  struct kring *r = p->ring;
+
+  if(r == 0)
+    return;
+  acquire(&r->lock);
+  r->stop = 1;
+  wakeup(&r->head);
+  release(&r->lock);
+}
+
+// Unmap and free p's ring, once its workers have exited.
+void
+ringfree(struct proc *p)
+{
+  struct kring *r = p->ring;
+
+  if(r == 0)
+    return;
+  p->ring = 0;
+  uvmunmap(p->pagetable, RING, 1, 1);
+  freelock(&r->lock);
+  kfree(r);
+}
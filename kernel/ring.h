@@ -0,0 +1,43 @@
+// Submission and completion rings for asynchronous file
+// system calls, shared between a process and the kernel's
+// ring workers; see ring.c.
+//
+// The process fills sq[sqtail % RINGSIZE] and then advances
+// sqtail; ringenter() takes entries from sqhead on and hands
+// them to the workers. Each finished request leaves a cqe at
+// cq[cqtail % RINGSIZE], and the process advances cqhead once
+// it has looked at it. No more than RINGSIZE requests may be
+// submitted and not yet reaped from cq.
+
+#define RINGSIZE 64       // entries in each ring
+
+// requests
+#define RING_READ  1      // read(fd, addr, n), at off unless off < 0
+#define RING_WRITE 2      // write(fd, addr, n), at off unless off < 0
+#define RING_OPEN  3      // open(addr, n)
+#define RING_CLOSE 4      // close(fd)
+#define RING_FSTAT 5      // fstat(fd, addr)
+
+struct sqe {
+  int op;
+  int fd;
+  uint64 addr;            // buffer, path, or struct stat
+  int n;                  // byte count, or open mode
+  int off;                // file offset, or -1 for the file's own
+  uint64 data;            // handed back in the cqe
+};
+
+struct cqe {
+  uint64 data;            // from the sqe
+  int res;                // what the system call would have returned
+  int pad;
+};
+
+struct ring {
+  uint sqhead;            // written by the kernel
+  uint sqtail;            // written by the process
+  uint cqhead;            // written by the process
+  uint cqtail;            // written by the kernel
+  struct sqe sq[RINGSIZE];
+  struct cqe cq[RINGSIZE];
+};
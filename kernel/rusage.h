@@ -0,0 +1,21 @@
+// Resource usage, for getrusage() and wait2().
+//
+// The kernel keeps one of these for each process, which all of
+// its threads add to, and one for its children that it has
+// waited for. All fields are uint64.
+
+#define RUSAGE_SELF      0
+#define RUSAGE_CHILDREN  (-1)
+
+struct rusage {
+  uint64 utime;           // user cpu time, in microseconds
+  uint64 stime;           // system cpu time, in microseconds
+  uint64 nvcsw;           // switches while waiting for something
+  uint64 nivcsw;          // switches because a time slice ran out
+  uint64 nfault;          // page faults taken on mmap()ed pages
+  uint64 inblock;         // blocks read from disk by bread()
+  uint64 oublock;         // blocks written with log_write()
+  uint64 npages;          // pages kalloc()ed
+};
+
+#define NRUSAGE (sizeof(struct rusage) / sizeof(uint64))
@@ -1,4 +1,11 @@
 // Sleeping locks
+//
+// A sleeplock is held either exclusively by one process, or
+// shared by any number of readers. A process waiting for the
+// exclusive lock keeps new readers out, so a steady stream of
+// readers can't starve it. Each process notes the locks it
+// holds shared in p->shared[], for holdingsleep(), and counts
+// all it holds in p->nsleep, for vmafault().
 
 #include "types.h"
 #include "riscv.h"
@@ -15,6 +22,9 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
+  lk->wwait = 0;
+  lk->rwait = 0;
   lk->pid = 0;
 }
 
@@ -22,34 +32,81 @@ void
 acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
-  while (lk->locked) {
+  lk->wwait++;
+  while (lk->locked || lk->readers) {
     sleep(lk, &lk->lk);
   }
+  lk->wwait--;
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  myproc()->nsleep++;
   release(&lk->lk);
 }
 
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  struct proc *p = myproc();
+  int i;
+
+  for(i = 0; i < NSHARED && p->shared[i]; i++)
+    ;
+  if(i == NSHARED)
+    panic("acquiresleepshared");
+
+  acquire(&lk->lk);
+  lk->rwait++;
+  while (lk->locked || lk->wwait) {
+    sleep(lk, &lk->lk);
+  }
+  lk->rwait--;
+  lk->readers++;
+  p->shared[i] = lk;
+  p->nsleep++;
+  release(&lk->lk);
+}
+
+// Release lk, however the caller holds it.
 void
 releasesleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+  int i;
+
   acquire(&lk->lk);
-  lk->locked = 0;
-  lk->pid = 0;
-  wakeup(lk);
+  if(lk->locked && lk->pid == p->pid){
+    lk->locked = 0;
+    lk->pid = 0;
+  } else {
+    for(i = 0; i < NSHARED && p->shared[i] != lk; i++)
+      ;
+    if(i == NSHARED)
+      panic("releasesleep");
+    p->shared[i] = 0;
+    lk->readers--;
+  }
+  p->nsleep--;
+  if(lk->locked == 0 && lk->readers == 0){
+    // hand the lock to the next writer, or let all the readers in.
+    if(lk->rwait)
+      wakeup(lk);
+    else
+      wakeupone(lk);
+  }
   release(&lk->lk);
 }
 
+// Does the caller hold lk, exclusively or shared?
 int
 holdingsleep(struct sleeplock *lk)
 {
-  int r;
+  struct proc *p = myproc();
+  int r, i;
   
   acquire(&lk->lk);
-  r = lk->locked && (lk->pid == myproc()->pid);
+  r = lk->locked && (lk->pid == p->pid);
   release(&lk->lk);
+  for(i = 0; i < NSHARED && !r; i++)
+    r = p->shared[i] == lk;
   return r;
 }
-
-
-
@@ -1,4 +1,14 @@
 // Mutual exclusion spin locks.
+//
+// By default a lock is a test-and-set word. Built with
+// TICKETLOCK, it is a ticket lock instead: each acquire()
+// takes the next ticket and waits for the owner count to
+// reach it, so waiters get the lock in the order they came,
+// and they spin reading, not swapping, the shared word.
+//
+// Each lock counts its acquisitions, the ones that had to
+// wait, and how long they spun; lockstat() sums these by
+// lock name for all the locks in locks[].
 
 #include "types.h"
 #include "param.h"
@@ -7,13 +17,71 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "lockstat.h"
+
+// Every initialized lock, for lockstat(). A lock that is
+// freed, like a pipe's, must be taken out by freelock().
+// listlock is a bare flag, since it guards spinlocks.
+static struct spinlock *locks[NLOCK];
+static uint listlock;
+
+static void
+lockslock(void)
+{
+  push_off();
+  while(__sync_lock_test_and_set(&listlock, 1) != 0)
+    ;
+  __sync_synchronize();
+}
+
+static void
+locksunlock(void)
+{
+  __sync_synchronize();
+  __sync_lock_release(&listlock);
+  pop_off();
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
+  int i;
+
   lk->name = name;
+#ifdef TICKETLOCK
+  lk->next = 0;
+  lk->owner = 0;
+#else
   lk->locked = 0;
+#endif
   lk->cpu = 0;
+  lk->nacquire = lk->ncontend = lk->nspin = 0;
+
+  // locks past NLOCK still work, but go uncounted.
+  lockslock();
+  for(i = 0; i < NLOCK; i++){
+    if(locks[i] == 0){
+      locks[i] = lk;
+      break;
+    }
+  }
+  locksunlock();
+}
+
+// lk's memory is about to be freed.
+void
+freelock(struct spinlock *lk)
+{
+  int i;
+
+  lockslock();
+  for(i = 0; i < NLOCK; i++){
+    if(locks[i] == lk){
+      locks[i] = 0;
+      break;
+    }
+  }
+  locksunlock();
 }
 
 // Acquire the lock.
@@ -21,16 +89,24 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 spins = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+#ifdef TICKETLOCK
+  uint ticket = __atomic_fetch_add(&lk->next, 1, __ATOMIC_RELAXED);
+  while(__atomic_load_n(&lk->owner, __ATOMIC_RELAXED) != ticket)
+    spins++;
+#else
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+    spins++;
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +116,11 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  lk->nacquire++;
+  if(spins){
+    lk->ncontend++;
+    lk->nspin += spins;
+  }
 }
 
 // Release the lock.
@@ -59,6 +140,10 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#ifdef TICKETLOCK
+  // let the next ticket in. only the holder writes owner.
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELAXED);
+#else
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -67,6 +152,7 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#endif
 
   pop_off();
 }
@@ -77,10 +163,65 @@ int
 holding(struct spinlock *lk)
 {
   int r;
+#ifdef TICKETLOCK
+  r = (lk->next != lk->owner && lk->cpu == mycpu());
+#else
   r = (lk->locked && lk->cpu == mycpu());
+#endif
   return r;
 }
 
+// Copy the statistics of up to n lock names, most contended
+// first, to user address addr. Returns the number copied,
+// or -1.
+int
+lockstats(uint64 addr, int n)
+{
+  struct lockstat *st, t;
+  struct spinlock *lk;
+  int i, j, nst = 0, max = PGSIZE / sizeof(*st);
+
+  if(n < 0 || (st = (struct lockstat*)kalloc()) == 0)
+    return -1;
+
+  // the counts are read without the locks, so they
+  // may be a little behind.
+  lockslock();
+  for(i = 0; i < NLOCK; i++){
+    if((lk = locks[i]) == 0)
+      continue;
+    for(j = 0; j < nst; j++)
+      if(strncmp(st[j].name, lk->name, sizeof(st[j].name) - 1) == 0)
+        break;
+    if(j == nst){
+      if(nst == max)
+        continue;
+      memset(&st[j], 0, sizeof(st[j]));
+      safestrcpy(st[j].name, lk->name, sizeof(st[j].name));
+      nst++;
+    }
+    st[j].nlock++;
+    st[j].nacquire += lk->nacquire;
+    st[j].ncontend += lk->ncontend;
+    st[j].nspin += lk->nspin;
+  }
+  locksunlock();
+
+  for(i = 1; i < nst; i++){
+    t = st[i];
+    for(j = i; j > 0 && st[j-1].ncontend < t.ncontend; j--)
+      st[j] = st[j-1];
+    st[j] = t;
+  }
+
+  if(n > nst)
+    n = nst;
+  if(copyout(myproc()->pagetable, addr, (char*)st, n * sizeof(*st)) < 0)
+    n = -1;
+  kfree(st);
+  return n;
+}
+
 // push_off/pop_off are like intr_off()/intr_on() except that they are matched:
 // it takes two pop_off()s to undo two push_off()s.  Also, if interrupts
 // are initially off, then push_off, pop_off leaves them off.
@@ -1,9 +1,19 @@
 // Mutual exclusion lock.
 struct spinlock {
+#ifdef TICKETLOCK
+  uint next;         // Next ticket to hand out
+  uint owner;        // Ticket now allowed in
+#else
   uint locked;       // Is the lock held?
+#endif
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // Statistics, updated by the holder:
+  uint64 nacquire;   // Times acquired
+  uint64 ncontend;   // Times acquire() had to wait
+  uint64 nspin;      // Spin iterations spent waiting
 };
 
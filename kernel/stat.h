@@ -10,3 +10,10 @@ struct stat {
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
 };
+
+// File system counters, for fsstat().
+struct fsstat {
+  uint64 nwrite;   // blocks written to disk since boot
+  uint64 ncommit;  // log transactions that wrote to disk
+  int delay;       // commitdelay() in effect
+};
@@ -20,4 +20,32 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
-#define SYS_symlink  23
\ No newline at end of file
+#define SYS_symlink  23
+#define SYS_mmap   24
+#define SYS_munmap 25
+#define SYS_setpriority 26
+#define SYS_clone  27
+#define SYS_join   28
+#define SYS_futex_wait 29
+#define SYS_futex_wake 30
+#define SYS_lockstat 31
+#define SYS_ringsetup 32
+#define SYS_ringenter 33
+#define SYS_pread  34
+#define SYS_pwrite 35
+#define SYS_readv  36
+#define SYS_writev 37
+#define SYS_sendfile 38
+#define SYS_splice 39
+#define SYS_fcntl  40
+#define SYS_poll   41
+#define SYS_fsync  42
+#define SYS_fdatasync 43
+#define SYS_sync   44
+#define SYS_commitdelay 45
+#define SYS_fsstat 46
+#define SYS_getrusage 47
+#define SYS_wait2  48
+#define SYS_profstart 49
+#define SYS_profstop 50
+#define SYS_profread 51
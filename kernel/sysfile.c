@@ -15,18 +15,29 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "ring.h"
+#include "uio.h"
+#include "poll.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// and return both the descriptor and the corresponding struct file,
+// without a reference. Only for close(), which then takes the
+// descriptor's reference with fdfree(); other system calls must
+// use argfile(), since another thread may close fd meanwhile.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
   int fd;
-  struct file *f;
+  struct file *f = 0;
+  struct proc *p = myproc()->leader;
 
-  if(argint(n, &fd) < 0)
+  if(argint(n, &fd) < 0 || fd < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  acquire(&p->shlock);
+  if(fd < p->nofile)
+    f = p->ofile[fd];
+  release(&p->shlock);
+  if(f == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -35,21 +46,99 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
+// Move p's descriptors from ofile0 to a page of NOFILEMAX.
+// Caller must hold p->shlock.
+static int
+fdgrow(struct proc *p)
+{
+  struct file **ofile;
+
+  if(p->nofile == NOFILEMAX || (ofile = (struct file **)kalloc()) == 0)
+    return -1;
+  memset(ofile, 0, PGSIZE);
+  memmove(ofile, p->ofile0, sizeof(p->ofile0));
+  p->ofile = ofile;
+  p->nofile = NOFILEMAX;
+  return 0;
+}
+
+// Allocate a file descriptor for the given file: the lowest
+// one that's free, found from the bitmap p->fdbits.
 // Takes over file reference from caller on success.
 static int
 fdalloc(struct file *f)
 {
-  int fd;
-  struct proc *p = myproc();
+  int i, fd;
+  uint64 w;
+  struct proc *p = myproc()->leader;
 
-  for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
-      return fd;
-    }
+  acquire(&p->shlock);
+  for(i = 0; i < NOFILEMAX/64; i++)
+    if(~p->fdbits[i] != 0)
+      break;
+  if(i == NOFILEMAX/64){
+    release(&p->shlock);
+    return -1;
   }
-  return -1;
+  w = p->fdbits[i];
+  for(fd = i*64; w & 1; fd++)
+    w >>= 1;
+  if(fd >= p->nofile && fdgrow(p) < 0){
+    release(&p->shlock);
+    return -1;
+  }
+  p->fdbits[fd/64] |= 1UL << (fd%64);
+  p->ofile[fd] = f;
+  release(&p->shlock);
+  return fd;
+}
+
+// Release descriptor fd, if it still refers to f; another
+// thread may have closed it already. Returns 0 or -1.
+static int
+fdfree(int fd, struct file *f)
+{
+  struct proc *p = myproc()->leader;
+  int r = -1;
+
+  acquire(&p->shlock);
+  if(p->ofile[fd] == f){
+    p->ofile[fd] = 0;
+    p->fdbits[fd/64] &= ~(1UL << (fd%64));
+    r = 0;
+  }
+  release(&p->shlock);
+  return r;
+}
+
+// Return the file open on descriptor fd, with a reference
+// that the caller must fileclose(), or 0 if there's none.
+static struct file*
+fdget(int fd)
+{
+  struct proc *p = myproc()->leader;
+  struct file *f = 0;
+
+  if(fd < 0)
+    return 0;
+  acquire(&p->shlock);
+  if(fd < p->nofile && (f = p->ofile[fd]) != 0)
+    filedup(f);
+  release(&p->shlock);
+  return f;
+}
+
+// Fetch the nth word-sized system call argument as a file
+// descriptor and return the file open on it, with a reference
+// that the caller must drop with fileclose().
+static int
+argfile(int n, struct file **pf)
+{
+  int fd;
+
+  if(argint(n, &fd) < 0 || (*pf = fdget(fd)) == 0)
+    return -1;
+  return 0;
 }
 
 uint64
@@ -58,11 +147,12 @@ sys_dup(void)
   struct file *f;
   int fd;
 
-  if(argfd(0, 0, &f) < 0)
+  if(argfile(0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -70,25 +160,257 @@ uint64
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfile(0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  vmaprefault(p, n);
+  r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
+  uint64 p;
+
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfile(0, &f) < 0)
+    return -1;
+  vmaprefault(p, n);
+  r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
+}
+
+// Read or write at an offset, leaving the file's own alone.
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off, r;
+  uint64 p;
+
+  if(argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0 ||
+     off < 0 || argfile(0, &f) < 0)
+    return -1;
+  vmaprefault(p, n);
+  r = filepread(f, p, n, off);
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off, r;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0 ||
+     off < 0 || argfile(0, &f) < 0)
+    return -1;
+  vmaprefault(p, n);
+  r = filepwrite(f, p, n, off);
+  fileclose(f);
+  return r;
+}
+
+// Move up to n bytes from file descriptor in to out, in the
+// kernel. in must be a file; out may be a file, pipe or device.
+uint64
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int n, r;
+
+  if(argint(2, &n) < 0 || argfile(0, &out) < 0)
+    return -1;
+  if(argfile(1, &in) < 0){
+    fileclose(out);
+    return -1;
+  }
+  r = filesend(out, in, n);
+  fileclose(in);
+  fileclose(out);
+  return r;
+}
+
+// Move up to n bytes from file descriptor in to out, where
+// one is a file and the other a pipe, without copying through
+// user space.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n, r;
+
+  if(argint(2, &n) < 0 || argfile(0, &in) < 0)
+    return -1;
+  if(argfile(1, &out) < 0){
+    fileclose(in);
+    return -1;
+  }
+  r = filesplice(in, out, n);
+  fileclose(out);
+  fileclose(in);
+  return r;
+}
+
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg, r;
+
+  if(argint(1, &cmd) < 0 || argint(2, &arg) < 0 || argfile(0, &f) < 0)
+    return -1;
+  r = filefcntl(f, cmd, arg);
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+  int r;
+
+  if(argfile(0, &f) < 0)
+    return -1;
+  r = filesync(f, 0);
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_fdatasync(void)
+{
+  struct file *f;
+  int r;
+
+  if(argfile(0, &f) < 0)
+    return -1;
+  r = filesync(f, 1);
+  fileclose(f);
+  return r;
+}
+
+// Make all changes so far durable.
+uint64
+sys_sync(void)
+{
+  log_force(log_tid());
+  return 0;
+}
+
+// commitdelay(ticks): let log commits be deferred by up to
+// ticks, until fsync() or sync(); 0 commits at every system
+// call, and a negative ticks changes nothing. Returns the
+// previous setting.
+uint64
+sys_commitdelay(void)
+{
+  int delay;
+
+  if(argint(0, &delay) < 0)
     return -1;
+  return commitdelay(delay);
+}
+
+uint64
+sys_fsstat(void)
+{
+  struct fsstat st;
+  uint64 addr;
 
-  return filewrite(f, p, n);
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  st.nwrite = bnwrite();
+  st.ncommit = log_ncommit();
+  st.delay = commitdelay(-1);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// poll(fds, n, timeout): wait until any of n fds is ready, or
+// for timeout ticks; forever if timeout is negative.
+uint64
+sys_poll(void)
+{
+  struct pollfd fds[NPOLL];
+  struct file *f[NPOLL];
+  struct proc *p = myproc();
+  uint64 addr;
+  int i, n, timeout, r;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(n < 0 || n > NPOLL)
+    return -1;
+  if(copyin(p->pagetable, (char*)fds, addr, n*sizeof(struct pollfd)) < 0)
+    return -1;
+  // hold the files, so that they stay open while poll() waits.
+  for(i = 0; i < n; i++)
+    f[i] = fds[i].fd >= 0 ? fdget(fds[i].fd) : 0;
+  r = poll(fds, f, n, timeout);
+  for(i = 0; i < n; i++)
+    if(f[i])
+      fileclose(f[i]);
+  if(r >= 0 && copyout(p->pagetable, addr, (char*)fds, n*sizeof(struct pollfd)) < 0)
+    return -1;
+  return r;
+}
+
+// Fetch the iovec array argument of readv() and writev().
+static int
+argiov(int n, struct iovec *iov, int *pcnt)
+{
+  uint64 addr;
+  int cnt, i;
+
+  if(argaddr(n, &addr) < 0 || argint(n+1, &cnt) < 0)
+    return -1;
+  if(cnt < 0 || cnt > IOVMAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, addr, cnt*sizeof(struct iovec)) < 0)
+    return -1;
+  for(i = 0; i < cnt; i++)
+    vmaprefault((uint64)iov[i].iov_base, iov[i].iov_len);
+  *pcnt = cnt;
+  return 0;
+}
+
+uint64
+sys_readv(void)
+{
+  struct iovec iov[IOVMAX];
+  struct file *f;
+  int cnt, r;
+
+  if(argiov(1, iov, &cnt) < 0 || argfile(0, &f) < 0)
+    return -1;
+  r = filereadv(f, iov, cnt);
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_writev(void)
+{
+  struct iovec iov[IOVMAX];
+  struct file *f;
+  int cnt, r;
+
+  if(argiov(1, iov, &cnt) < 0 || argfile(0, &f) < 0)
+    return -1;
+  r = filewritev(f, iov, cnt);
+  fileclose(f);
+  return r;
 }
 
 uint64
@@ -97,9 +419,8 @@ sys_close(void)
   int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  if(argfd(0, &fd, &f) < 0 || fdfree(fd, f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
@@ -109,10 +430,13 @@ sys_fstat(void)
 {
   struct file *f;
   uint64 st; // user pointer to struct stat
+  int r;
 
-  if(argfd(0, 0, &f) < 0 || argaddr(1, &st) < 0)
+  if(argaddr(1, &st) < 0 || argfile(0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -332,17 +656,14 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-uint64
-sys_open(void)
+// Open path with mode omode, for open() and RING_OPEN.
+// Returns the new file descriptor, or -1.
+static int
+openpath(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
-    return -1;
 
   begin_op();
       
@@ -358,7 +679,7 @@ sys_open(void)
       return -1;
     }
     ilock(ip);
-    if(ip->type == T_DIR && omode != O_RDONLY){
+    if(ip->type == T_DIR && (omode & ~O_NONBLOCK) != O_RDONLY){
       iunlockput(ip);
       end_op();
       return -1;
@@ -418,6 +739,7 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
@@ -429,6 +751,17 @@ sys_open(void)
   return fd;
 }
 
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int omode;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return openpath(path, omode);
+}
+
 uint64
 sys_mkdir(void)
 {
@@ -469,8 +802,8 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
-  struct proc *p = myproc();
+  struct inode *ip, *old;
+  struct proc *p = myproc()->leader;
   
   begin_op();
   if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
@@ -484,9 +817,12 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
-  end_op();
+  acquire(&p->shlock);
+  old = p->cwd;
   p->cwd = ip;
+  release(&p->shlock);
+  iput(old);
+  end_op();
   return 0;
 }
 
@@ -547,18 +883,117 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
+      fdfree(fd0, rf);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    fdfree(fd0, rf);
+    fdfree(fd1, wf);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   return 0;
 }
+
+uint64
+sys_mmap(void)
+{
+  uint64 addr;
+  int len, prot, flags, fd, off;
+  struct file *f = 0;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(4, &fd) < 0 || argint(5, &off) < 0)
+    return -1;
+  // the kernel picks the address.
+  if(addr != 0 || len <= 0 || off < 0)
+    return -1;
+  if(fd != -1 && argfile(4, &f) < 0)
+    return -1;
+  addr = vmammap(len, prot, flags, f, off);
+  if(f)
+    fileclose(f);
+  return addr;
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr;
+  int len;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || len <= 0)
+    return -1;
+  return vmaunmap(addr, len);
+}
+
+uint64
+sys_ringsetup(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return ringsetup(n);
+}
+
+uint64
+sys_ringenter(void)
+{
+  int n, minwait;
+
+  if(argint(0, &n) < 0 || argint(1, &minwait) < 0)
+    return -1;
+  return ringenter(n, minwait);
+}
+
+// Carry out ring request e, in one of the process's ring
+// workers; see ring.c. Returns what the system call would.
+int
+ringop(struct sqe *e)
+{
+  char path[MAXPATH];
+  struct file *f;
+  int r;
+
+  if(e->op == RING_OPEN){
+    if(fetchstr(e->addr, path, MAXPATH) < 0)
+      return -1;
+    return openpath(path, e->n);
+  }
+
+  if((f = fdget(e->fd)) == 0)
+    return -1;
+  if(e->op == RING_READ || e->op == RING_WRITE)
+    vmaprefault(e->addr, e->n);
+  switch(e->op){
+  case RING_READ:
+    if(e->off < 0)
+      r = fileread(f, e->addr, e->n);
+    else
+      r = filepread(f, e->addr, e->n, e->off);
+    break;
+  case RING_WRITE:
+    if(e->off < 0)
+      r = filewrite(f, e->addr, e->n);
+    else
+      r = filepwrite(f, e->addr, e->n, e->off);
+    break;
+  case RING_CLOSE:
+    // drop the descriptor's reference as well as fdget()'s.
+    if((r = fdfree(e->fd, f)) == 0)
+      fileclose(f);
+    break;
+  case RING_FSTAT:
+    r = filestat(f, e->addr);
+    break;
+  default:
+    r = -1;
+  }
+  fileclose(f);
+  return r;
+}
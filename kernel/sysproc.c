@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "rusage.h"
 
 uint64
 sys_exit(void)
@@ -35,9 +36,57 @@ sys_wait(void)
   uint64 p;
   if(argaddr(0, &p) < 0)
     return -1;
+  // wait() copies out under p->lock; see vmaprefault().
+  vmaprefault(p, sizeof(int));
   return wait(p);
 }
 
+uint64
+sys_wait2(void)
+{
+  uint64 p, ru;
+  if(argaddr(0, &p) < 0 || argaddr(1, &ru) < 0)
+    return -1;
+  vmaprefault(p, sizeof(int));
+  vmaprefault(ru, sizeof(struct rusage));
+  return wait2(p, ru);
+}
+
+uint64
+sys_getrusage(void)
+{
+  int who;
+  uint64 ru;
+  if(argint(0, &who) < 0 || argaddr(1, &ru) < 0)
+    return -1;
+  return getrusage(who, ru);
+}
+
+uint64
+sys_profstart(void)
+{
+  int rate;
+  if(argint(0, &rate) < 0)
+    return -1;
+  return profstart(rate);
+}
+
+uint64
+sys_profstop(void)
+{
+  return profstop();
+}
+
+uint64
+sys_profread(void)
+{
+  uint64 p;
+  int n;
+  if(argaddr(0, &p) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  return profread(p, n);
+}
+
 uint64
 sys_sbrk(void)
 {
@@ -46,7 +95,7 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
+  addr = myproc()->leader->sz;
   if(growproc(n) < 0)
     return -1;
   return addr;
@@ -56,21 +105,12 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n <= 0)
+    return 0;
+  return timersleep(r_time() + (uint64)n * TICKINTERVAL);
 }
 
 uint64
@@ -83,15 +123,74 @@ sys_kill(void)
   return kill(pid);
 }
 
+uint64
+sys_setpriority(void)
+{
+  int pid, prio;
+
+  if(argint(0, &pid) < 0 || argint(1, &prio) < 0)
+    return -1;
+  return setpriority(pid, prio);
+}
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, a0, a1, stack, stacksz;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &a0) < 0 || argaddr(2, &a1) < 0 ||
+     argaddr(3, &stack) < 0 || argaddr(4, &stacksz) < 0)
+    return -1;
+  return clone(fn, a0, a1, stack, stacksz);
+}
+
+uint64
+sys_join(void)
+{
+  uint64 p;
+  if(argaddr(0, &p) < 0)
+    return -1;
+  vmaprefault(p, sizeof(uint64));
+  return join(p);
+}
+
+uint64
+sys_futex_wait(void)
+{
+  uint64 addr;
+  int val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+uint64
+sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake(addr, n);
+}
+
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return lockstats(addr, n);
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
-
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  return uptime();
 }
@@ -0,0 +1,211 @@
+// Deadline timers.
+//
+// Each hart's CLINT timer is programmed for that hart's next
+// event only, rather than interrupting at a fixed rate:
+// * a busy hart, one running processes, gets a scheduling tick
+//   every TICKINTERVAL cycles, for schedtick();
+// * a process in sleep(n) goes on the timer list of the hart it
+//   called from, and that hart's timer fires at its deadline;
+// * an idle hart takes no ticks at all, just its deadlines;
+// * while the profiler is on, a busy hart also takes a sample
+//   every profinterval cycles; see prof.c.
+//
+// The machine-mode handler, timervec in kernelvec.S, disarms the
+// timer and forwards the interrupt to timerintr() as a supervisor
+// software interrupt; timerintr() then wakes expired sleepers,
+// each exactly once, and programs the next event. Supervisor
+// mode writes the hart's MTIMECMP itself; start() sets up PMP
+// so that it may.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "clock.h"
+#include "defs.h"
+
+#define NEVER (~0UL)
+
+// time of the next periodic scheduler boost.
+static uint64 nextboost = BOOSTTICKS * TICKINTERVAL;
+
+void
+tminit(void)
+{
+  for(int i = 0; i < NCPU; i++){
+    initlock(&cpus[i].tmlock, "timer");
+    cpus[i].armed = NEVER;
+  }
+}
+
+// Ticks since boot.
+uint
+uptime(void)
+{
+  return r_time() / TICKINTERVAL;
+}
+
+// Fill in the constant part of a new clock page.
+void
+clockpageinit(struct clockpage *cp)
+{
+  memset(cp, 0, PGSIZE);
+  cp->hz = TIMEBASE;
+  cp->tickcycles = TICKINTERVAL;
+  cp->nsshift = 20;
+  cp->nsmult = (1000000000UL << cp->nsshift) / TIMEBASE;
+}
+
+// Program this hart's timer for its next event: the soonest
+// deadline on its timer list and, if it is busy, its next tick
+// or profiling sample.
+// Caller must hold c->tmlock and be running on c.
+static void
+timerarm(struct cpu *c)
+{
+  uint64 next = NEVER;
+
+  if(c->busy)
+    next = c->nexttick;
+  if(c->busy && profinterval && c->nextsample < next)
+    next = c->nextsample;
+  if(c->tmhead && c->tmhead->wakeat < next)
+    next = c->tmhead->wakeat;
+  if(next != c->armed){
+    c->armed = next;
+    *(uint64*)CLINT_MTIMECMP(cpuid()) = next;
+  }
+}
+
+// The scheduler on this hart is about to run a process (busy
+// is 1) or has nothing to run (busy is 0). Start or stop the
+// scheduling tick to match.
+void
+timerbusy(int busy)
+{
+  struct cpu *c;
+
+  push_off();
+  c = mycpu();
+  if(c->busy != busy){
+    acquire(&c->tmlock);
+    c->busy = busy;
+    c->nexttick = r_time() + TICKINTERVAL;
+    c->nextsample = r_time() + profinterval;
+    timerarm(c);
+    release(&c->tmlock);
+  }
+  pop_off();
+}
+
+// Put the current process on c's timer list, for timerintr()
+// to take it off, clear p->wakeat and wakeup(&p->wakeat) when
+// the time CSR reaches wakeat.
+// Caller must hold c->tmlock and be running on c.
+void
+timeradd(struct cpu *c, uint64 wakeat)
+{
+  struct proc *p = myproc();
+  struct proc **pp;
+
+  // the list is in deadline order.
+  p->wakeat = wakeat;
+  for(pp = &c->tmhead; *pp && (*pp)->wakeat <= wakeat; pp = &(*pp)->tmnext)
+    ;
+  p->tmnext = *pp;
+  *pp = p;
+  timerarm(c);
+}
+
+// Take the current process off c's timer list, if its
+// deadline hasn't passed yet.
+// Caller must hold c->tmlock.
+void
+timerdel(struct cpu *c)
+{
+  struct proc *p = myproc();
+  struct proc **pp;
+
+  if(p->wakeat == 0)
+    return;
+  for(pp = &c->tmhead; *pp != p; pp = &(*pp)->tmnext)
+    ;
+  *pp = p->tmnext;
+  p->wakeat = 0;
+}
+
+// Sleep until the time CSR reaches wakeat.
+// Returns 0, or -1 if the process was killed.
+int
+timersleep(uint64 wakeat)
+{
+  struct proc *p = myproc();
+  struct cpu *c;
+
+  // stay on this hart until its timer is armed.
+  push_off();
+  c = mycpu();
+  acquire(&c->tmlock);
+  pop_off();
+
+  timeradd(c, wakeat);
+  while(p->wakeat){
+    if(p->killed){
+      timerdel(c);
+      release(&c->tmlock);
+      return -1;
+    }
+    sleep(&p->wakeat, &c->tmlock);
+  }
+  release(&c->tmlock);
+  return 0;
+}
+
+// Handle this hart's timer interrupt, forwarded by timervec.
+// Returns 1 if a scheduling tick has passed, 0 if the
+// interrupt was only for sleepers' deadlines.
+int
+timerintr(void)
+{
+  struct cpu *c = mycpu();
+  uint64 now = r_time();
+  uint64 boost, interval;
+  struct proc *p;
+  int tick = 0, sample = 0;
+
+  acquire(&c->tmlock);
+  // timervec disarmed the timer, unless this was another
+  // hart's tlbshootdown(), in which case at worst an early
+  // interrupt is left armed.
+  c->armed = NEVER;
+  c->ntimer++;
+  while((p = c->tmhead) != 0 && p->wakeat <= now){
+    c->tmhead = p->tmnext;
+    p->wakeat = 0;
+    wakeup(&p->wakeat);
+  }
+  if(c->busy && now >= c->nexttick){
+    tick = 1;
+    c->nexttick = now + TICKINTERVAL;
+  }
+  interval = __atomic_load_n(&profinterval, __ATOMIC_RELAXED);
+  if(c->busy && interval && now >= c->nextsample){
+    sample = 1;
+    c->nextsample = now + interval;
+  }
+  timerarm(c);
+  release(&c->tmlock);
+
+  if(sample)
+    profsample();
+
+  // whichever busy hart first sees the boost time pass does it.
+  boost = __atomic_load_n(&nextboost, __ATOMIC_RELAXED);
+  if(tick && now >= boost &&
+     __sync_bool_compare_and_swap(&nextboost, boost, now + BOOSTTICKS * TICKINTERVAL))
+    schedboost();
+
+  return tick;
+}
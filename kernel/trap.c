@@ -4,10 +4,9 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "clock.h"
 #include "defs.h"
 
-struct spinlock tickslock;
-uint ticks;
 
 extern char trampoline[], uservec[], userret[];
 
@@ -19,7 +18,6 @@ extern int devintr();
 void
 trapinit(void)
 {
-  initlock(&tickslock, "time");
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -45,7 +43,11 @@ usertrap(void)
   // since we're now in the kernel.
   w_stvec((uint64)kernelvec);
 
+  // uservec flushed this hart's TLB; see tlbshootdown().
+  __atomic_add_fetch(&mycpu()->ugen, 1, __ATOMIC_RELEASE);
+
   struct proc *p = myproc();
+  chargetime(p, 1);
   
   // save user program counter.
   p->trapframe->epc = r_sepc();
@@ -64,7 +66,12 @@ usertrap(void)
     // so don't enable until done with those registers.
     intr_on();
 
+    __sync_fetch_and_add(&p->leader->clock->nsyscall, 1);
     syscall();
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            vmafault(p->pagetable, r_stval()) == 0){
+    // page fault on a demand-paged page, which is now mapped.
+    __sync_fetch_and_add(&p->leader->clock->nfault, 1);
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -76,9 +83,9 @@ usertrap(void)
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
+  // maybe give up the CPU if this is a timer interrupt.
   if(which_dev == 2)
-    yield();
+    schedtick();
 
   usertrapret();
 }
@@ -96,6 +103,10 @@ usertrapret(void)
   // we're back in user space, where usertrap() is correct.
   intr_off();
 
+  // the time from here on is the process's own.
+  chargetime(p, 0);
+  __atomic_add_fetch(&mycpu()->ugen, 1, __ATOMIC_RELEASE);
+
   // send syscalls, interrupts, and exceptions to trampoline.S
   w_stvec(TRAMPOLINE + (uservec - trampoline));
 
@@ -125,7 +136,7 @@ usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(p->trapva, satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -137,37 +148,37 @@ kerneltrap()
   uint64 sepc = r_sepc();
   uint64 sstatus = r_sstatus();
   uint64 scause = r_scause();
+  int idle;
   
   if((sstatus & SSTATUS_SPP) == 0)
     panic("kerneltrap: not from supervisor mode");
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
+  // the handler may enter RCU read sections, which grace
+  // periods don't wait for on an idle cpu.
+  if((idle = mycpu()->rcuidle) != 0)
+    rcu_idle(0);
+
   if((which_dev = devintr()) == 0){
     printf("scause %p\n", scause);
     printf("sepc=%p stval=%p\n", r_sepc(), r_stval());
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
+  // maybe give up the CPU if this is a timer interrupt.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    yield();
+    schedtick();
 
-  // the yield() may have caused some traps to occur,
+  if(idle)
+    rcu_idle(1);
+
+  // the schedtick() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
   w_sepc(sepc);
   w_sstatus(sstatus);
 }
 
-void
-clockintr()
-{
-  acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
-  release(&tickslock);
-}
-
 // check if it's an external interrupt or software interrupt,
 // and handle it.
 // returns 2 if timer interrupt,
@@ -201,18 +212,17 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer or
+    // software interrupt, forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
+    // the SSIP bit in sip, before timerintr() arms the
+    // timer again, so that we can't miss the next one.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    // only a scheduling tick counts as a timer interrupt
+    // for the callers; deadlines just wake sleepers.
+    return timerintr() ? 2 : 1;
   } else {
     return 0;
   }
@@ -0,0 +1,8 @@
+// Buffers for readv() and writev().
+
+#define IOVMAX 16         // most buffers in one call
+
+struct iovec {
+  void *iov_base;
+  int iov_len;
+};
@@ -33,6 +33,9 @@ kvmmake(void)
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
+  // CLINT, for timer.c to program each hart's timer.
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
@@ -49,11 +52,41 @@ kvmmake(void)
   return kpgtbl;
 }
 
+// Count the page-table pages in pagetable, and its leaf
+// PTEs at each level, for kvmreport().
+static void
+pgcount(pagetable_t pagetable, int level, int *ntables, int *nleaves)
+{
+  *ntables += 1;
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if((pte & PTE_V) == 0)
+      continue;
+    if(PTE_LEAF(pte))
+      nleaves[level]++;
+    else
+      pgcount((pagetable_t)PTE2PA(pte), level-1, ntables, nleaves);
+  }
+}
+
+// Print how much page table the kernel's map takes.
+static void
+kvmreport(pagetable_t kpgtbl)
+{
+  int ntables = 0;
+  int nleaves[3] = { 0, 0, 0 };
+
+  pgcount(kpgtbl, 2, &ntables, nleaves);
+  printf("kvm: %d page-table pages, %d 4K + %d 2M + %d 1G mappings\n",
+         ntables, nleaves[0], nleaves[1], nleaves[2]);
+}
+
 // Initialize the one kernel_pagetable
 void
 kvminit(void)
 {
   kernel_pagetable = kvmmake();
+  kvmreport(kernel_pagetable);
 }
 
 // Switch h/w page table register to the kernel's page table,
@@ -77,15 +110,31 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// A leaf PTE at level 1 or 2 maps a 2MB or 1GB superpage,
+// which has no level-0 PTE; if walk() meets one, it returns 0.
+// Use walkleaf() to find whichever PTE maps va.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, 0, alloc);
+}
+
+// Like walk(), but return the PTE at the given level
+// (0, 1 or 2) rather than at level 0, e.g. to install
+// a superpage leaf. Returns 0 if a superpage above that
+// level covers va.
+pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int level, int alloc)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
-    pte_t *pte = &pagetable[PX(level, va)];
+  for(int l = 2; l > level; l--) {
+    pte_t *pte = &pagetable[PX(l, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte))
+        return 0;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
       if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
@@ -94,7 +143,7 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
-  return &pagetable[PX(0, va)];
+  return &pagetable[PX(level, va)];
 }
 
 // Look up a virtual address, return the physical address,
@@ -104,80 +153,150 @@ uint64
 walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
-  uint64 pa;
+  uint64 pa, pgsize;
 
   if(va >= MAXVA)
     return 0;
 
-  pte = walk(pagetable, va, 0);
+  pte = walkleaf(pagetable, va, &pgsize);
   if(pte == 0)
     return 0;
   if((*pte & PTE_V) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
+  pa = PTE2PA(*pte) + (PGROUNDDOWN(va) & (pgsize - 1));
   return pa;
 }
 
+// Return the PTE that maps va, without allocating: a
+// superpage leaf if va lies in one, else the level-0 PTE,
+// which may be invalid. Sets *pgsize to the number of
+// bytes that the PTE maps. Returns 0 if a page-table
+// page on the way down is missing.
+pte_t *
+walkleaf(pagetable_t pagetable, uint64 va, uint64 *pgsize)
+{
+  if(va >= MAXVA)
+    panic("walkleaf");
+
+  for(int level = 2; level > 0; level--) {
+    pte_t *pte = &pagetable[PX(level, va)];
+    if((*pte & PTE_V) == 0)
+      return 0;
+    if(PTE_LEAF(*pte)){
+      *pgsize = LEVELSIZE(level);
+      return pte;
+    }
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  }
+  *pgsize = PGSIZE;
+  return &pagetable[PX(0, va)];
+}
+
 // add a mapping to the kernel page table.
+// uses 1GB and 2MB superpages wherever va, pa and the
+// remaining size are aligned to them, to save page-table
+// pages and TLB entries; 4KB pages elsewhere.
 // only used when booting.
 // does not flush TLB or enable paging.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  uint64 end, n;
+  int level;
+
+  end = PGROUNDDOWN(va + sz - 1) + PGSIZE;
+  va = PGROUNDDOWN(va);
+  while(va < end){
+    for(level = 2; level > 0; level--){
+      n = LEVELSIZE(level);
+      if(va % n == 0 && pa % n == 0 && end - va >= n)
+        break;
+    }
+    n = LEVELSIZE(level);
+    if(mappages_level(kpgtbl, va, n, pa, perm, level) != 0)
+      panic("kvmmap");
+    va += n;
+    pa += n;
+  }
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned. Returns 0 on success, -1 if walk() couldn't
-// allocate a needed page-table page.
+// allocate a needed page-table page or met a superpage.
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
-  uint64 a, last;
+  return mappages_level(pagetable, PGROUNDDOWN(va),
+                        PGROUNDDOWN(va + size - 1) + PGSIZE - PGROUNDDOWN(va),
+                        pa, perm, 0);
+}
+
+// Like mappages(), but with leaf PTEs at the given level:
+// 0 for 4KB pages, 1 for 2MB megapages, 2 for 1GB gigapages.
+// va, size and pa must be aligned to that page size.
+int
+mappages_level(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa,
+               int perm, int level)
+{
+  uint64 a, last, pgsize = LEVELSIZE(level);
   pte_t *pte;
 
-  a = PGROUNDDOWN(va);
-  last = PGROUNDDOWN(va + size - 1);
+  if(size == 0)
+    panic("mappages: size");
+  if(va % pgsize || size % pgsize || pa % pgsize)
+    panic("mappages: not aligned");
+
+  a = va;
+  last = va + size - pgsize;
   for(;;){
-    if((pte = walk(pagetable, a, 1)) == 0)
+    if((pte = walklevel(pagetable, a, level, 1)) == 0)
       return -1;
     if(*pte & PTE_V)
       panic("remap");
     *pte = PA2PTE(pa) | perm | PTE_V;
     if(a == last)
       break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    a += pgsize;
+    pa += pgsize;
   }
   return 0;
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that were never faulted in (see vma.c)
+// are skipped. A megapage must be removed as a whole, or
+// split first with uvmsplit().
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, pgsize;
   pte_t *pte;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
+  for(a = va; a < va + npages*PGSIZE; a += pgsize){
+    pgsize = PGSIZE;
+    if((pte = walkleaf(pagetable, a, &pgsize)) == 0)
+      continue;
     if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
+    if(a % pgsize != 0 || a + pgsize > va + npages*PGSIZE)
+      panic("uvmunmap: part of a megapage");
     if(do_free){
       uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+      if(pgsize == MEGAPGSIZE)
+        kfreemega((void*)pa);
+      else if(pgsize == PGSIZE)
+        kfree((void*)pa);
+      else
+        panic("uvmunmap: gigapage");
     }
     *pte = 0;
   }
@@ -259,14 +378,15 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 }
 
 // Recursively free page-table pages.
-// All leaf mappings must already have been removed.
+// All leaf mappings, including megapage leaves in
+// the upper levels, must already have been removed.
 void
 freewalk(pagetable_t pagetable)
 {
   // there are 2^9 = 512 PTEs in a page table.
   for(int i = 0; i < 512; i++){
     pte_t pte = pagetable[i];
-    if((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0){
+    if((pte & PTE_V) && PTE_LEAF(pte) == 0){
       // this PTE points to a lower-level page table.
       uint64 child = PTE2PA(pte);
       freewalk((pagetable_t)child);
@@ -291,39 +411,92 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 // Given a parent process's page table, copy
 // its memory into a child's page table.
 // Copies both the page table and the
-// physical memory.
+// physical memory, except that read-only pages
+// are shared, and pages that haven't been
+// faulted in are left for the child to fault in.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+{
+  return uvmcopy_range(old, new, 0, PGROUNDUP(sz), 0);
+}
+
+// Like uvmcopy(), but for the page-aligned range [start, end).
+// Megapages are copied into new megapages. If share is set,
+// new maps the same physical pages as old instead, as for a
+// MAP_SHARED region; share doesn't work for megapages.
+int
+uvmcopy_range(pagetable_t old, pagetable_t new, uint64 start, uint64 end, int share)
 {
   pte_t *pte;
-  uint64 pa, i;
+  uint64 pa, i, pgsize;
   uint flags;
   char *mem;
+  int level;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
+  for(i = start; i < end; i += pgsize){
+    pgsize = PGSIZE;
+    if((pte = walkleaf(old, i, &pgsize)) == 0)
+      continue;
     if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+      continue;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+    level = (pgsize == MEGAPGSIZE);
+    if(pgsize == PGSIZE && (share || (flags & PTE_W) == 0)){
+      mem = (char*)pa;
+      kdup(mem);
+    } else {
+      if(pgsize == MEGAPGSIZE)
+        mem = kallocmega();
+      else
+        mem = kalloc();
+      if(mem == 0)
+        goto err;
+      memmove(mem, (char*)pa, pgsize);
+    }
+    if(mappages_level(new, i, pgsize, (uint64)mem, flags, level) != 0){
+      if(pgsize == MEGAPGSIZE)
+        kfreemega(mem);
+      else
+        kfree(mem);
       goto err;
     }
   }
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
+// If a megapage maps va, replace its leaf with a page-table
+// page of 4K leaves for the same memory, so that part of it
+// can be unmapped. Returns 0, or -1 if out of memory.
+int
+uvmsplit(pagetable_t pagetable, uint64 va)
+{
+  pagetable_t pt;
+  pte_t *pte;
+  uint64 pa, pgsize;
+  int i;
+
+  if((pte = walkleaf(pagetable, va, &pgsize)) == 0 || (*pte & PTE_V) == 0 ||
+     pgsize == PGSIZE)
+    return 0;
+  if(pgsize != MEGAPGSIZE)
+    panic("uvmsplit: gigapage");
+  if((pt = (pagetable_t)kalloc()) == 0)
+    return -1;
+  // kallocmega() gave each 4K page its own reference.
+  pa = PTE2PA(*pte);
+  for(i = 0; i < 512; i++)
+    pt[i] = PA2PTE(pa + i*PGSIZE) | PTE_FLAGS(*pte);
+  *pte = PA2PTE(pt) | PTE_V;
+  return 0;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -337,6 +510,51 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Take user access away from npages of memory at va, but leave
+// them mapped, so that a thread on another hart that reloads one
+// of them into its TLB faults on it. For munmap() and sbrk() to
+// call before tlbshootdown() and uvmunmap().
+void
+uvmrevoke(pagetable_t pagetable, uint64 va, uint64 npages)
+{
+  uint64 a, pgsize;
+  pte_t *pte;
+
+  for(a = va; a < va + npages*PGSIZE; a += pgsize){
+    pgsize = PGSIZE;
+    if((pte = walkleaf(pagetable, a, &pgsize)) != 0)
+      *pte &= ~PTE_U;
+  }
+}
+
+// Look up a user virtual address for copyin() and friends,
+// faulting in a demand-paged page if it isn't mapped yet.
+// Return the physical address, or 0 if the page isn't
+// mapped, or if write is set and the page is read-only.
+uint64
+uvmaddr(pagetable_t pagetable, uint64 va, int write)
+{
+  pte_t *pte;
+  uint64 pgsize;
+
+  if(va >= MAXVA)
+    return 0;
+
+  pte = walkleaf(pagetable, va, &pgsize);
+  if(pte == 0 || (*pte & PTE_V) == 0){
+    if(vmafault(pagetable, va) < 0)
+      return 0;
+    pte = walkleaf(pagetable, va, &pgsize);
+  }
+  if((*pte & PTE_U) == 0)
+    return 0;
+  if(write && (*pte & PTE_W) == 0)
+    return 0;
+  if(write)
+    *pte |= PTE_D;  // for MAP_SHARED writeback
+  return PTE2PA(*pte) + (PGROUNDDOWN(va) & (pgsize - 1));
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -347,7 +565,7 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmaddr(pagetable, va0, 1);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -372,7 +590,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -399,7 +617,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -429,3 +647,64 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
     return -1;
   }
 }
+
+#ifdef MEMBENCH
+// Memory-bandwidth microbenchmark, to see what the kernel's
+// superpage mappings buy: write and then read MBPAGES pages
+// that kalloc() hands out from all over physical memory,
+// through the direct map. Build with make MEMBENCH=1.
+#define MBPAGES 2048  // 8 MB
+#define MBPASSES 4
+
+static char *mbpages[MBPAGES];
+
+// Print MB/s for nbytes in t cycles of the time CSR.
+static void
+mbprint(char *what, uint64 nbytes, uint64 t)
+{
+  if(t == 0)
+    t = 1;
+  printf("membench: %s %d MB/s\n", what, (int)(nbytes * TIMEBASE / t / (1024*1024)));
+}
+
+void
+kvmbench(void)
+{
+  uint64 t0, t1, sum, nbytes;
+  int i, n, pass;
+
+  for(n = 0; n < MBPAGES; n++)
+    if((mbpages[n] = kalloc()) == 0)
+      break;
+  nbytes = (uint64)n * PGSIZE * MBPASSES;
+
+  t0 = r_time();
+  for(pass = 0; pass < MBPASSES; pass++)
+    for(i = 0; i < n; i++)
+      memset(mbpages[i], pass, PGSIZE);
+  t1 = r_time();
+  mbprint("write", nbytes, t1 - t0);
+
+  sum = 0;
+  t0 = r_time();
+  for(pass = 0; pass < MBPASSES; pass++)
+    for(i = 0; i < n; i++)
+      for(uint64 *w = (uint64*)mbpages[i]; w < (uint64*)(mbpages[i] + PGSIZE); w++)
+        sum += *(volatile uint64*)w;
+  t1 = r_time();
+  mbprint("read", nbytes, t1 - t0);
+
+  t0 = r_time();
+  for(pass = 0; pass < MBPASSES; pass++)
+    for(i = 1; i < n; i++)
+      memmove(mbpages[i-1], mbpages[i], PGSIZE);
+  t1 = r_time();
+  mbprint("copy", nbytes, t1 - t0);
+
+  if(sum == 1)  // keep the reads from being optimized away.
+    printf("membench: sum %p\n", sum);
+
+  for(i = 0; i < n; i++)
+    kfree(mbpages[i]);
+}
+#endif
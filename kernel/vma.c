@@ -0,0 +1,551 @@
+// Demand paging.
+//
+// exec() doesn't read a program into memory. It describes each
+// loadable segment with a struct vma, and pages are filled in
+// when the program first touches them, either from a page fault
+// in usertrap() or when copyin()/copyout() reach an unmapped page.
+// Read-only pages that lie wholly inside the file are mapped
+// straight from the page cache, so they are shared by every
+// process running the same file. Other pages get a private copy.
+//
+// mmap() adds regions above the heap, allocated downwards from
+// MMAPTOP. Anonymous regions with MAP_HUGE are faulted in 2MB
+// megapages at a time, which saves TLB entries and page-table
+// pages for large arrays. File regions come from the page cache
+// too: MAP_SHARED ones map the cached pages themselves, so loads
+// and stores go straight to the file's one in-memory copy, and
+// dirty pages are written back through the log by munmap(),
+// exit() and exec(). MAP_PRIVATE ones get copies, like data.
+//
+// The threads of a process share its leader's vmas and page
+// table, under the leader's shlock. A fault fills its page
+// without the lock, since that may sleep, and counts itself in
+// nfault meanwhile; munmap() waits for nfault to drain, so a
+// region never goes away under a fault that is filling it.
+//
+// Lock order: filling a page from a file takes the inode's
+// sleeplock and buffer locks, so it must come before any other
+// lock, never inside one. A copyout() from readi() under the
+// inode lock of the same or another file, or from piperead()
+// under a pipe's spinlock, must not read a file in. So
+// vmafault() reads a file only for a process holding no locks
+// at all: on a page fault from user space, or in a system
+// call's copyin() of its arguments. System calls that copy
+// user buffers under locks, such as read() and write(), call
+// vmaprefault() on the buffers first; a copy that still meets
+// an unfilled page of a file then fails. Zero-fill pages need
+// only shlock and kalloc(), which come after every other lock,
+// so copies fill those themselves.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "stat.h"
+
+// Return the vma of p that contains va, or 0.
+struct vma*
+vmalookup(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->used && va >= v->start && va < v->end)
+      return v;
+  }
+  return 0;
+}
+
+// Return a vma of p that overlaps [start, end), or 0.
+struct vma*
+vmaoverlap(struct proc *p, uint64 start, uint64 end)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->used && start < v->end && v->start < end)
+      return v;
+  }
+  return 0;
+}
+
+// Fill in the page of v that holds va, which is not mapped yet.
+// Returns a physical page with a reference for the caller,
+// or 0 if out of memory. *perm is set to the PTE permissions.
+static char*
+vmapage(struct vma *v, uint64 va, int *perm)
+{
+  uint64 a = PGROUNDDOWN(va);
+  uint off, n;
+  char *mem, *pa;
+  int how;
+
+  *perm = v->perm | PTE_U;
+
+  if(v->ip == 0 || a - v->start >= v->filesz){
+    // entirely past the file's content: zero-fill.
+    if((mem = kalloc()) == 0)
+      return 0;
+    memset(mem, 0, PGSIZE);
+    return mem;
+  }
+
+  off = v->off + (a - v->start);
+  n = v->filesz - (a - v->start);
+  if(n > PGSIZE)
+    n = PGSIZE;
+
+  ilockshared(v->ip);
+
+  mem = 0;
+  if(off % PGSIZE == 0){
+    // share the cached page if it is MAP_SHARED, or read-only
+    // and whole, like program text; else copy it.
+    if(v->flags & MAP_SHARED)
+      how = MAP_SHARED;
+    else if((v->perm & PTE_W) == 0 && n == PGSIZE)
+      how = MAP_PRIVATE;
+    else
+      how = 0;
+    if((pa = pcget(v->ip, off, how)) != 0){
+      if(how){
+        mem = pa;
+      } else {
+        // private copy, with zeroes past the end of the segment.
+        if((mem = kalloc()) != 0){
+          memmove(mem, pa, n);
+          memset(mem + n, 0, PGSIZE - n);
+        }
+        kfree(pa);
+      }
+    }
+  } else if((mem = kalloc()) != 0){
+    // the segment isn't page-aligned in the file,
+    // so it can't come from the page cache.
+    memset(mem, 0, PGSIZE);
+    if(readi(v->ip, 0, (uint64)mem, off, n) < 0){
+      kfree(mem);
+      mem = 0;
+    }
+  }
+
+  iunlock(v->ip);
+  return mem;
+}
+
+// Try to map the whole megapage of huge vma v that holds va.
+// Returns 0 on success, -1 if the caller should fall back to
+// a 4K page, since megapages are scarce or a page-table page
+// already covers the range.
+static int
+vmafaultmega(pagetable_t pagetable, struct vma *v, uint64 va)
+{
+  uint64 a = MEGAPGROUNDDOWN(va);
+  pte_t *pte;
+  char *mem;
+
+  if(a < v->start || a + MEGAPGSIZE > v->end)
+    return -1;
+  if((pte = walklevel(pagetable, a, 1, 0)) != 0 && (*pte & PTE_V))
+    return -1;
+  if((mem = kallocmega()) == 0)
+    return -1;
+  memset(mem, 0, MEGAPGSIZE);
+  if(mappages_level(pagetable, a, MEGAPGSIZE, (uint64)mem, v->perm | PTE_U, 1) != 0){
+    kfreemega(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Does the current process hold no locks, spin or sleep?
+static int
+holdingnone(void)
+{
+  int noff;
+
+  push_off();
+  noff = mycpu()->noff;
+  pop_off();
+  return noff == 1 && myproc()->nsleep == 0;
+}
+
+// Map the demand-paged page that holds user address va.
+// pagetable must be the current process's.
+// A page of a file is read in only if the caller holds
+// no locks; see the lock order above.
+// Returns 0 on success, -1 if va isn't in a vma, is
+// already mapped, needs a file read that the caller's
+// locks forbid, or there's no memory.
+int
+vmafault(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc(), *lp;
+  struct vma *v, copy;
+  pte_t *pte;
+  uint64 pgsize;
+  char *mem;
+  int perm, r, last, unlocked;
+
+  if(p == 0 || pagetable != p->pagetable || va >= MAXVA)
+    return -1;
+  unlocked = holdingnone();
+  lp = p->leader;
+  acquire(&lp->shlock);
+  if((v = vmalookup(lp, va)) == 0 || (v->flags == 0 && va >= p->sz) ||
+     ((pte = walkleaf(pagetable, va, &pgsize)) != 0 && (*pte & PTE_V)) ||
+     (v->ip && PGROUNDDOWN(va) - v->start < v->filesz && !unlocked)){
+    release(&lp->shlock);
+    return -1;
+  }
+
+  if((v->flags & MAP_HUGE) && vmafaultmega(pagetable, v, va) == 0){
+    release(&lp->shlock);
+    return 0;
+  }
+
+  copy = *v;
+  lp->nfault++;
+  release(&lp->shlock);
+
+  mem = vmapage(&copy, va, &perm);
+
+  acquire(&lp->shlock);
+  r = -1;
+  if(mem == 0){
+    // out of memory.
+  } else if((pte = walkleaf(pagetable, va, &pgsize)) != 0 && (*pte & PTE_V)){
+    // another thread faulted the page in first.
+    kfree(mem);
+    r = 0;
+  } else if(mappages(pagetable, PGROUNDDOWN(va), PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+  } else {
+    r = 0;
+  }
+  last = --lp->nfault == 0;
+  release(&lp->shlock);
+  if(last)
+    wakeup(&lp->nfault);
+  return r;
+}
+
+// Read in the pages of [va, va+len) that come from a file, for
+// a system call that is about to copy to or from them while
+// holding locks. The caller must hold none yet.
+void
+vmaprefault(uint64 va, uint64 len)
+{
+  struct proc *p = myproc(), *lp = p->leader;
+  struct vma *v;
+  pte_t *pte;
+  uint64 a, start, end, pgsize;
+  int i;
+
+  if(va >= MAXVA || len >= MAXVA)
+    return;
+  for(i = 0; i < NVMA; i++){
+    // the part of the i'th region that holds file content.
+    acquire(&lp->shlock);
+    v = &lp->vma[i];
+    start = end = 0;
+    if(v->used && v->ip){
+      start = PGROUNDDOWN(va) > v->start ? PGROUNDDOWN(va) : v->start;
+      end = va + len < v->start + v->filesz ? va + len : v->start + v->filesz;
+    }
+    release(&lp->shlock);
+
+    for(a = start; a < end; a += PGSIZE){
+      if((pte = walkleaf(p->pagetable, a, &pgsize)) == 0 || (*pte & PTE_V) == 0)
+        vmafault(p->pagetable, a);
+    }
+  }
+}
+
+// Give child np copies of p's vmas, e.g. for fork().
+// The pages of mmap() regions are copied too, except that
+// MAP_SHARED pages are shared; those of exec()'s regions
+// are copied with the rest of p->sz.
+// Returns 0 on success, -1 if out of memory, in which
+// case np is left with no vmas.
+int
+vmadup(struct proc *np, struct proc *p)
+{
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    v = &p->vma[i];
+    if(!v->used || v->flags == 0)
+      continue;
+    if(uvmcopy_range(p->pagetable, np->pagetable, v->start, v->end,
+                     v->flags & MAP_SHARED) < 0){
+      while(--i >= 0){
+        v = &p->vma[i];
+        if(v->used && v->flags)
+          uvmunmap(np->pagetable, v->start, (v->end - v->start) / PGSIZE, 1);
+      }
+      return -1;
+    }
+  }
+
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = p->vma[i];
+    if(np->vma[i].used && np->vma[i].ip)
+      idup(np->vma[i].ip);
+  }
+  return 0;
+}
+
+// Write the dirty pages of MAP_SHARED region v that lie in
+// [start, end) back to the file, a few blocks per transaction
+// as in filewrite(). Bytes past the end of the file are
+// dropped; a mapping never extends its file.
+static void
+vmawriteback(pagetable_t pagetable, struct vma *v, uint64 start, uint64 end)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint64 a, pgsize;
+  uint off, i, n;
+  pte_t *pte;
+  char *pa;
+
+  for(a = start; a < end; a += PGSIZE){
+    if((pte = walkleaf(pagetable, a, &pgsize)) == 0)
+      continue;
+    if((*pte & PTE_V) == 0 || (*pte & PTE_D) == 0)
+      continue;
+    pa = (char*)PTE2PA(*pte);
+    off = v->off + (a - v->start);
+    for(i = 0; i < PGSIZE; i += n){
+      n = PGSIZE - i;
+      if(n > max)
+        n = max;
+      begin_op();
+      ilock(v->ip);
+      if(off + i >= v->ip->size){
+        n = PGSIZE - i;
+      } else {
+        if(n > v->ip->size - (off + i))
+          n = v->ip->size - (off + i);
+        writei(v->ip, 0, (uint64)pa + i, off + i, n);
+      }
+      iunlock(v->ip);
+      end_op();
+    }
+  }
+}
+
+// Release the vmas in vma[]. If pagetable isn't 0, also
+// write back, unmap and free the pages of mmap() regions,
+// which lie outside p->sz and so aren't freed with the rest.
+// Must not be called inside a transaction; it starts its own.
+void
+vmafree(pagetable_t pagetable, struct vma *vma)
+{
+  struct vma *v;
+
+  for(v = vma; v < &vma[NVMA]; v++){
+    if(v->used && v->flags && pagetable){
+      if(v->flags & MAP_SHARED)
+        vmawriteback(pagetable, v, v->start, v->end);
+      uvmunmap(pagetable, v->start, (v->end - v->start) / PGSIZE, 1);
+    }
+    if(v->used && v->ip){
+      begin_op();
+      iput(v->ip);
+      end_op();
+    }
+    memset(v, 0, sizeof(*v));
+  }
+}
+
+// Find a free range of len bytes for mmap(), aligned to align,
+// below MMAPTOP and above the heap. Returns 0 if there is none.
+static uint64
+vmaspace(struct proc *p, uint64 len, uint64 align)
+{
+  uint64 top = MMAPTOP, start;
+  struct vma *v;
+
+  for(;;){
+    if(top < len)
+      return 0;
+    start = (top - len) & ~(align - 1);
+    if(start < PGROUNDUP(p->sz))
+      return 0;
+    if((v = vmaoverlap(p, start, start + len)) == 0)
+      return start;
+    top = v->start;
+  }
+}
+
+// Create a demand-paged mmap() region of len bytes in the
+// current process, of anonymous memory if f is 0, else of
+// f's content from page-aligned offset off. Anonymous
+// regions must be MAP_PRIVATE; MAP_HUGE asks for 2MB
+// megapages for them, and then len must be a multiple of 2MB.
+// Returns the start address, or -1.
+uint64
+vmammap(uint64 len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc()->leader;
+  uint64 align = PGSIZE, start;
+  struct vma *v;
+  int perm = 0;
+
+  if(len == 0 || len > MMAPTOP)
+    return -1;
+  if(((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+    return -1;
+  if(f == 0){
+    if((flags & MAP_ANONYMOUS) == 0 || (flags & MAP_SHARED))
+      return -1;
+  } else {
+    if((flags & (MAP_ANONYMOUS|MAP_HUGE)) || f->type != FD_INODE)
+      return -1;
+    if(off % PGSIZE || f->ip->type != T_FILE || !f->readable)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  }
+  if(flags & MAP_HUGE){
+    if(len % MEGAPGSIZE)
+      return -1;
+    align = MEGAPGSIZE;
+  }
+  len = PGROUNDUP(len);
+
+  // RISC-V has no write-only pages, and a PTE with
+  // none of R, W and X would point to a page table.
+  if(prot & PROT_READ)
+    perm |= PTE_R;
+  if(prot & PROT_WRITE)
+    perm |= PTE_R | PTE_W;
+  if(prot & PROT_EXEC)
+    perm |= PTE_X;
+  if(perm == 0)
+    return -1;
+
+  acquire(&p->shlock);
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(!v->used)
+      break;
+  }
+  if(v == &p->vma[NVMA] || (start = vmaspace(p, len, align)) == 0){
+    release(&p->shlock);
+    return -1;
+  }
+
+  memset(v, 0, sizeof(*v));
+  v->used = 1;
+  v->start = start;
+  v->end = start + len;
+  v->perm = perm;
+  v->flags = flags;
+  if(f){
+    v->ip = idup(f->ip);
+    v->off = off;
+    v->filesz = len;
+  }
+  release(&p->shlock);
+  return start;
+}
+
+// Return the mmap() region of p that [addr, end) can be
+// removed from, or 0. Caller must hold p->shlock.
+static struct vma*
+vmaunmappable(struct proc *p, uint64 addr, uint64 end)
+{
+  struct vma *v;
+
+  if((v = vmalookup(p, addr)) == 0 || v->flags == 0 || end > v->end)
+    return 0;
+  if(addr != v->start && end != v->end)
+    return 0;
+  return v;
+}
+
+// Remove [addr, addr+len) from the current process's mmap()
+// regions. The range must be the whole of one region, or cut
+// from its start or end. A megapage that the cut goes through
+// is split into 4K pages. Returns 0 on success, -1 on error.
+int
+vmaunmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc()->leader;
+  struct vma *v, copy;
+  uint64 end;
+  int r, whole = 0;
+
+  if(addr % PGSIZE || len == 0)
+    return -1;
+  end = addr + PGROUNDUP(len);
+
+  acquire(&p->shlock);
+  if((v = vmaunmappable(p, addr, end)) == 0){
+    release(&p->shlock);
+    return -1;
+  }
+  copy = *v;
+  if(copy.ip)
+    idup(copy.ip);
+  release(&p->shlock);
+
+  // writing back sleeps, so do it without the lock,
+  // holding a reference to the file in case another
+  // thread unmaps the region meanwhile.
+  if(copy.flags & MAP_SHARED)
+    vmawriteback(p->pagetable, &copy, addr, end);
+
+  acquire(&p->shlock);
+  while(p->nfault > 0)
+    sleep(&p->nfault, &p->shlock);
+  if((v = vmaunmappable(p, addr, end)) == 0 || v->ip != copy.ip){
+    release(&p->shlock);
+    r = -1;
+    goto out;
+  }
+  if(uvmsplit(p->pagetable, addr) < 0 ||
+     (end < v->end && uvmsplit(p->pagetable, end) < 0)){
+    release(&p->shlock);
+    r = -1;
+    goto out;
+  }
+  // other threads may still be using the pages.
+  uvmrevoke(p->pagetable, addr, (end - addr) / PGSIZE);
+  tlbshootdown(p);
+  uvmunmap(p->pagetable, addr, (end - addr) / PGSIZE, 1);
+
+  whole = addr == v->start && end == v->end;
+  if(whole){
+    memset(v, 0, sizeof(*v));
+  } else if(addr == v->start){
+    if(v->ip){
+      v->off += end - v->start;
+      v->filesz -= end - v->start;
+    }
+    v->start = end;
+  } else {
+    v->end = addr;
+  }
+  release(&p->shlock);
+  r = 0;
+
+out:
+  if(copy.ip){
+    begin_op();
+    iput(copy.ip);
+    if(whole)
+      iput(copy.ip);
+    end_op();
+  }
+  return r;
+}
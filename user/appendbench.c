@@ -0,0 +1,122 @@
+// Log-append benchmark.
+//
+// Appends nrec records to a log file, each a header, a payload
+// and a newline: first with a write() per part, and then with
+// one writev() per record, which also puts each record in a
+// single file system transaction. Then checks some records
+// with pread(). Reports the append rate and system calls.
+//
+// usage: appendbench [nrec [payload]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/uio.h"
+#include "user/user.h"
+
+#define HDRSIZE 11        // "rec NNNNNN "
+
+char hdr[HDRSIZE+1];
+char payload[1024];
+char rec[HDRSIZE+1024+1];
+
+// Fill hdr with the header of record i.
+void
+mkhdr(int i)
+{
+  int d;
+
+  memmove(hdr, "rec ", 4);
+  for(d = HDRSIZE-2; d >= 4; d--, i /= 10)
+    hdr[d] = '0' + i % 10;
+  hdr[HDRSIZE-1] = ' ';
+}
+
+int
+openlog(void)
+{
+  int fd;
+
+  if((fd = open("appendbench.log", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "appendbench: create failed\n");
+    exit(1);
+  }
+  return fd;
+}
+
+void
+report(char *what, int nrec, int nsyscall, uint64 ns)
+{
+  printf("%s: %d records/s, %d syscalls\n", what,
+         (int)((uint64)nrec * 1000000000 / (ns + 1)), nsyscall);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nrec = 1000, n = 100;
+  int i, fd, recsize;
+  uint64 start;
+  struct iovec iov[3];
+  struct stat st;
+
+  if(argc > 1)
+    nrec = atoi(argv[1]);
+  if(argc > 2)
+    n = atoi(argv[2]);
+  if(nrec < 1 || nrec > 999999 || n < 0 || n > sizeof(payload)){
+    fprintf(2, "usage: appendbench [nrec [payload]]\n");
+    exit(1);
+  }
+  memset(payload, 'x', n);
+  recsize = HDRSIZE + n + 1;
+
+  fd = openlog();
+  start = nsnow();
+  for(i = 0; i < nrec; i++){
+    mkhdr(i);
+    if(write(fd, hdr, HDRSIZE) != HDRSIZE || write(fd, payload, n) != n ||
+       write(fd, "\n", 1) != 1){
+      fprintf(2, "appendbench: write failed\n");
+      exit(1);
+    }
+  }
+  report("write", nrec, 3*nrec, nsnow() - start);
+  close(fd);
+
+  fd = openlog();
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = HDRSIZE;
+  iov[1].iov_base = payload;
+  iov[1].iov_len = n;
+  iov[2].iov_base = "\n";
+  iov[2].iov_len = 1;
+  start = nsnow();
+  for(i = 0; i < nrec; i++){
+    mkhdr(i);
+    if(writev(fd, iov, 3) != recsize){
+      fprintf(2, "appendbench: writev failed\n");
+      exit(1);
+    }
+  }
+  report("writev", nrec, nrec, nsnow() - start);
+  close(fd);
+
+  if((fd = open("appendbench.log", O_RDONLY)) < 0 || fstat(fd, &st) < 0 ||
+     st.size != nrec * recsize){
+    fprintf(2, "appendbench: log has the wrong size\n");
+    exit(1);
+  }
+  for(i = 0; i < nrec; i += 1 + nrec / 10){
+    mkhdr(i);
+    if(pread(fd, rec, recsize, i * recsize) != recsize ||
+       memcmp(rec, hdr, HDRSIZE) != 0 || rec[recsize-1] != '\n'){
+      fprintf(2, "appendbench: record %d is wrong\n", i);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  unlink("appendbench.log");
+  exit(0);
+}
@@ -0,0 +1,88 @@
+// Parallel read benchmark.
+//
+// Runs 1, 2, 4, ... processes that each read the same file
+// from start to end, over and over, like cat with its output
+// thrown away, and reports the total read rate. Readers take
+// the inode lock shared, so they shouldn't wait for each other.
+// The file is kept small enough by default to stay in the
+// buffer cache, so that the disk doesn't set the pace.
+//
+// usage: catbench [maxprocs [kbytes [rounds]]]
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char buf[4096];
+
+void
+reader(int rounds)
+{
+  int fd, i;
+
+  for(i = 0; i < rounds; i++){
+    if((fd = open("catbench.data", O_RDONLY)) < 0){
+      fprintf(2, "catbench: open failed\n");
+      exit(1);
+    }
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxprocs = 4, kbytes = 24, rounds = 200;
+  int n, i, fd;
+  uint64 start, us;
+
+  if(argc > 1)
+    maxprocs = atoi(argv[1]);
+  if(argc > 2)
+    kbytes = atoi(argv[2]);
+  if(argc > 3)
+    rounds = atoi(argv[3]);
+  // init, sh and catbench itself need procs too.
+  if(maxprocs < 1 || maxprocs > NPROC-3 || kbytes < 1 || rounds < 1){
+    fprintf(2, "usage: catbench [maxprocs [kbytes [rounds]]]\n");
+    exit(1);
+  }
+
+  if((fd = open("catbench.data", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "catbench: create failed\n");
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < kbytes; i++){
+    if(write(fd, buf, 1024) != 1024){
+      fprintf(2, "catbench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  for(n = 1; n <= maxprocs; n *= 2){
+    start = nsnow();
+    for(i = 0; i < n; i++){
+      int pid = fork();
+      if(pid < 0){
+        fprintf(2, "catbench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0)
+        reader(rounds);
+    }
+    for(i = 0; i < n; i++)
+      wait(0);
+    us = (nsnow() - start) / 1000 + 1;
+    printf("%d readers: %d KB/s\n", n,
+           (int)((uint64)n * kbytes * rounds * 1000000 / us));
+  }
+
+  unlink("catbench.data");
+  exit(0);
+}
@@ -0,0 +1,54 @@
+// Clock-reading benchmark.
+//
+// Reads the time n times with uptime(), a system call that
+// counts whole ticks, and then with clock_gettime(), which
+// reads the time CSR and the clock page without entering the
+// kernel. Reports the cost of each, measured by the time CSR,
+// and the system calls the process made meanwhile, from the
+// clock page's counter.
+//
+// usage: clockbench [n]
+
+#include "kernel/types.h"
+#include "kernel/clock.h"
+#include "user/user.h"
+
+void
+report(char *what, int n, uint64 cycles, uint64 nsyscall)
+{
+  struct clockpage *cp = clockpage();
+
+  printf("%s: %d ns per call, %d system calls\n", what,
+         (int)(cycles * 1000000000 / cp->hz / n), (int)nsyscall);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct clockpage *cp = clockpage();
+  struct timespec ts;
+  uint64 t0, s0;
+  int i, n = 100000;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1){
+    fprintf(2, "usage: clockbench [n]\n");
+    exit(1);
+  }
+
+  s0 = cp->nsyscall;
+  t0 = rdtime();
+  for(i = 0; i < n; i++)
+    uptime();
+  report("uptime()", n, rdtime() - t0, cp->nsyscall - s0);
+
+  s0 = cp->nsyscall;
+  t0 = rdtime();
+  for(i = 0; i < n; i++)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+  report("clock_gettime()", n, rdtime() - t0, cp->nsyscall - s0);
+
+  printf("resolution: %d ns\n", (int)(1000000000 / cp->hz));
+  exit(0);
+}
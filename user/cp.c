@@ -0,0 +1,43 @@
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char buf[4096];
+
+int
+main(int argc, char *argv[])
+{
+  int src, dst, n;
+
+  if(argc != 3){
+    fprintf(2, "usage: cp src dst\n");
+    exit(1);
+  }
+  if((src = open(argv[1], O_RDONLY)) < 0){
+    fprintf(2, "cp: cannot open %s\n", argv[1]);
+    exit(1);
+  }
+  if((dst = open(argv[2], O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "cp: cannot create %s\n", argv[2]);
+    exit(1);
+  }
+
+  // copy block to block in the kernel, or else by hand.
+  while((n = sendfile(dst, src, 1 << 20)) > 0)
+    ;
+  if(n < 0){
+    while((n = read(src, buf, sizeof(buf))) > 0){
+      if(write(dst, buf, n) != n){
+        fprintf(2, "cp: write error\n");
+        exit(1);
+      }
+    }
+    if(n < 0){
+      fprintf(2, "cp: read error\n");
+      exit(1);
+    }
+  }
+  close(src);
+  close(dst);
+  exit(0);
+}
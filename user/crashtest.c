@@ -0,0 +1,96 @@
+// Crash test for fsync().
+//
+// "crashtest" defers log commits for a long time, writes one
+// file and fsync()s it, writes another without, and then waits
+// for the machine to be killed (ctrl-a x in qemu). After the
+// next boot, "crashtest check" verifies that the fsync()ed file
+// is intact, and reports whether the other one survived; it
+// needn't have.
+//
+// usage: crashtest [check]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define DELAY 100000      // ticks, for commitdelay()
+#define NBLK 8
+
+char buf[1024];
+
+// Write NBLK blocks of a pattern to name.
+int
+fill(char *name)
+{
+  int fd, i;
+
+  if((fd = open(name, O_CREATE|O_TRUNC|O_WRONLY)) < 0)
+    return -1;
+  for(i = 0; i < NBLK; i++){
+    memset(buf, 'a' + i, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+// Does name hold what fill() wrote?
+int
+intact(char *name)
+{
+  int fd, i, j;
+
+  if((fd = open(name, O_RDONLY)) < 0)
+    return 0;
+  for(i = 0; i < NBLK; i++){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf))
+      break;
+    for(j = 0; j < sizeof(buf); j++)
+      if(buf[j] != 'a' + i)
+        break;
+    if(j < sizeof(buf))
+      break;
+  }
+  close(fd);
+  return i == NBLK;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd;
+
+  if(argc > 1 && strcmp(argv[1], "check") == 0){
+    if(!intact("crash.sync")){
+      printf("crashtest: FAILED, fsync()ed data was lost\n");
+      exit(1);
+    }
+    printf("crashtest: OK, fsync()ed data survived; ");
+    printf("the other file %s\n", intact("crash.lazy") ? "did too" : "didn't");
+    unlink("crash.sync");
+    unlink("crash.lazy");
+    exit(0);
+  }
+  if(argc > 1){
+    fprintf(2, "usage: crashtest [check]\n");
+    exit(1);
+  }
+
+  commitdelay(DELAY);
+  if((fd = fill("crash.sync")) < 0 || fsync(fd) < 0){
+    fprintf(2, "crashtest: writing crash.sync failed\n");
+    exit(1);
+  }
+  close(fd);
+  if((fd = fill("crash.lazy")) < 0){
+    fprintf(2, "crashtest: writing crash.lazy failed\n");
+    exit(1);
+  }
+  close(fd);
+  printf("crashtest: now kill qemu (ctrl-a x), boot again, and run crashtest check\n");
+  for(;;)
+    sleep(1000);
+}
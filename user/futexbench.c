@@ -0,0 +1,111 @@
+// Futex lock benchmark.
+//
+// Times ulib's futex-based mutex and condition variable:
+// * uncontended: one thread locking and unlocking, which
+//   never enters the kernel;
+// * contended: nthread threads incrementing one counter under
+//   one mutex, so lockers often find it held and sleep;
+// * handoff: two threads taking turns through a condition
+//   variable, so that every turn is a futex wakeup.
+//
+// usage: futexbench [nthread [n]]
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define MAXTHREAD 7
+
+struct mutex m;
+struct cond cv;
+int counter;
+int turn;
+int iters;
+
+void
+incr(void *arg)
+{
+  int i;
+
+  for(i = 0; i < iters; i++){
+    mutex_lock(&m);
+    counter++;
+    mutex_unlock(&m);
+  }
+}
+
+// Take turn me of two, n times.
+void
+pingpong(void *arg)
+{
+  int me = (uint64)arg, i;
+
+  for(i = 0; i < iters; i++){
+    mutex_lock(&m);
+    while(turn != me)
+      cond_wait(&cv, &m);
+    turn = !me;
+    cond_broadcast(&cv);
+    mutex_unlock(&m);
+  }
+}
+
+void
+report(char *what, int n, uint64 ns)
+{
+  printf("%s: %d in %d us, %d ns each\n", what, n, (int)(ns / 1000),
+         (int)(ns / n));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nthread = 4, n = 100000;
+  int i;
+  uint64 start;
+
+  if(argc > 1)
+    nthread = atoi(argv[1]);
+  if(argc > 2)
+    n = atoi(argv[2]);
+  if(nthread < 1 || nthread > MAXTHREAD || n < 1000){
+    fprintf(2, "usage: futexbench [nthread [n]]\n");
+    exit(1);
+  }
+
+  start = nsnow();
+  for(i = 0; i < n; i++){
+    mutex_lock(&m);
+    counter++;
+    mutex_unlock(&m);
+  }
+  report("uncontended lock/unlock", n, nsnow() - start);
+
+  counter = 0;
+  iters = n / nthread;
+  start = nsnow();
+  for(i = 0; i < nthread; i++){
+    if(thread_create(incr, 0) < 0){
+      fprintf(2, "futexbench: thread_create failed\n");
+      exit(1);
+    }
+  }
+  for(i = 0; i < nthread; i++)
+    thread_join();
+  if(counter != iters * nthread){
+    fprintf(2, "futexbench: counter is %d, not %d\n", counter, iters * nthread);
+    exit(1);
+  }
+  printf("%d threads, ", nthread);
+  report("contended lock/unlock", iters * nthread, nsnow() - start);
+
+  iters = n / 10;
+  start = nsnow();
+  if(thread_create(pingpong, (void*)0) < 0 || thread_create(pingpong, (void*)1) < 0){
+    fprintf(2, "futexbench: thread_create failed\n");
+    exit(1);
+  }
+  thread_join();
+  thread_join();
+  report("condvar handoff", iters * 2, nsnow() - start);
+  exit(0);
+}
@@ -2,11 +2,43 @@
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/fcntl.h"
 #include "user/user.h"
 
 char buf[1024];
 int match(char*, char*);
 
+// lines end at a newline, or at the NUL that grep()
+// puts in place of the newline.
+#define EOL(c) ((c) == '\0' || (c) == '\n')
+
+// Search a regular file in place through mmap(), without
+// copying it. Like grep(), ignores a last line that has no
+// newline. Returns -1 if fd can't be mapped.
+int
+grepmap(char *pattern, int fd)
+{
+  struct stat st;
+  char *base, *end, *p, *q;
+
+  if(fstat(fd, &st) < 0 || st.type != T_FILE || st.size == 0)
+    return -1;
+  base = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(base == (char*)-1)
+    return -1;
+  end = base + st.size;
+  for(p = base; p < end; p = q+1){
+    for(q = p; q < end && *q != '\n'; q++)
+      ;
+    if(q == end)
+      break;
+    if(match(pattern, p))
+      write(1, p, q+1 - p);
+  }
+  munmap(base, st.size);
+  return 0;
+}
+
 void
 grep(char *pattern, int fd)
 {
@@ -55,7 +87,8 @@ main(int argc, char *argv[])
       printf("grep: cannot open %s\n", argv[i]);
       exit(1);
     }
-    grep(pattern, fd);
+    if(grepmap(pattern, fd) < 0)
+      grep(pattern, fd);
     close(fd);
   }
   exit(0);
@@ -75,7 +108,7 @@ match(char *re, char *text)
   do{  // must look at empty string
     if(matchhere(re, text))
       return 1;
-  }while(*text++ != '\0');
+  }while(!EOL(*text++));
   return 0;
 }
 
@@ -87,8 +120,8 @@ int matchhere(char *re, char *text)
   if(re[1] == '*')
     return matchstar(re[0], re+2, text);
   if(re[0] == '$' && re[1] == '\0')
-    return *text == '\0';
-  if(*text!='\0' && (re[0]=='.' || re[0]==*text))
+    return EOL(*text);
+  if(!EOL(*text) && (re[0]=='.' || re[0]==*text))
     return matchhere(re+1, text+1);
   return 0;
 }
@@ -99,7 +132,7 @@ int matchstar(int c, char *re, char *text)
   do{  // a * matches zero or more instances
     if(matchhere(re, text))
       return 1;
-  }while(*text!='\0' && (*text++==c || c=='.'));
+  }while(!EOL(*text) && (*text++==c || c=='.'));
   return 0;
 }
 
@@ -0,0 +1,104 @@
+// Pointer-chasing benchmark for huge-page mmap().
+//
+// Follows a random cycle through a 64MB anonymous region, one
+// node per 4K page, so nearly every step misses the TLB when
+// the region is mapped with 4K pages. With MAP_HUGE the same
+// region needs only 32 TLB entries.
+//
+// usage: hugebench [rounds]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define REGION (64*1024*1024)
+#define NNODE  (REGION / PGSIZE)
+
+static uint64 rnd = 0x2545F4914F6CDD1DULL;
+
+static uint64
+xorshift(void)
+{
+  rnd ^= rnd << 13;
+  rnd ^= rnd >> 7;
+  rnd ^= rnd << 17;
+  return rnd;
+}
+
+// Address of node i. Nodes are spread over the cache lines
+// of their pages so that they don't all fight over one set.
+static uint64*
+node(char *base, int i)
+{
+  return (uint64*)(base + (uint64)i*PGSIZE + (i % 64) * 64);
+}
+
+static void
+run(char *name, int flags, int rounds)
+{
+  char *base;
+  int *perm;
+  int i, j, t;
+  uint64 *n, start, ns;
+
+  base = mmap(0, REGION, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE|flags, -1, 0);
+  if(base == (char*)-1){
+    printf("hugebench: mmap %s failed\n", name);
+    exit(1);
+  }
+
+  // a single random cycle through all nodes (Sattolo's algorithm).
+  perm = malloc(NNODE * sizeof(int));
+  if(perm == 0){
+    printf("hugebench: out of memory\n");
+    exit(1);
+  }
+  for(i = 0; i < NNODE; i++)
+    perm[i] = i;
+  for(i = NNODE-1; i > 0; i--){
+    j = xorshift() % i;
+    t = perm[i];
+    perm[i] = perm[j];
+    perm[j] = t;
+  }
+  for(i = 0; i < NNODE; i++)
+    *node(base, i) = (uint64)node(base, perm[i]);
+  free(perm);
+
+  start = nsnow();
+  n = node(base, 0);
+  for(i = 0; i < rounds; i++)
+    for(j = 0; j < NNODE; j++)
+      n = (uint64*)*n;
+  ns = nsnow() - start;
+
+  if(n != node(base, 0)){
+    printf("hugebench: chase didn't return to the start\n");
+    exit(1);
+  }
+  printf("%s pages: %d steps in %d us, %d ns each\n", name, rounds*NNODE,
+         (int)(ns / 1000), (int)(ns / ((uint64)rounds*NNODE)));
+
+  if(munmap(base, REGION) < 0){
+    printf("hugebench: munmap %s failed\n", name);
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rounds = 64;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds <= 0){
+    fprintf(2, "usage: hugebench [rounds]\n");
+    exit(1);
+  }
+
+  run("4K", 0, rounds);
+  run("2M", MAP_HUGE, rounds);
+  exit(0);
+}
@@ -0,0 +1,124 @@
+// Scheduling latency benchmark.
+//
+// Starts nhog CPU-bound processes, then repeatedly sleeps for a
+// tick and times a one-byte round trip through an echo process,
+// the way an interactive program waits for input and responds.
+// Reports the distribution of response times, in microseconds,
+// first with the hogs at the default priority and then with them
+// lowered by setpriority().
+//
+// usage: latbench [nhog [nsample]]
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define MAXSAMPLE 1000
+
+int hogs[NPROC];
+int sample[MAXSAMPLE];  // microseconds
+
+void
+sort(int *a, int n)
+{
+  int i, j, t;
+
+  for(i = 1; i < n; i++){
+    t = a[i];
+    for(j = i; j > 0 && a[j-1] > t; j--)
+      a[j] = a[j-1];
+    a[j] = t;
+  }
+}
+
+void
+measure(char *what, int nsample, int wfd, int rfd)
+{
+  int i;
+  uint64 start, sum;
+  char c = 'x';
+
+  for(i = 0; i < nsample; i++){
+    sleep(1);
+    start = nsnow();
+    if(write(wfd, &c, 1) != 1 || read(rfd, &c, 1) != 1){
+      fprintf(2, "latbench: echo failed\n");
+      exit(1);
+    }
+    sample[i] = (nsnow() - start) / 1000;
+  }
+
+  sort(sample, nsample);
+  sum = 0;
+  for(i = 0; i < nsample; i++)
+    sum += sample[i];
+  printf("%s: mean %dus p50 %dus p90 %dus p99 %dus max %dus\n", what,
+         (int)(sum / nsample),
+         sample[nsample/2],
+         sample[nsample*90/100],
+         sample[nsample*99/100],
+         sample[nsample-1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nhog = 3, nsample = 50;
+  int to[2], from[2];
+  int i, pid;
+  char c;
+
+  if(argc > 1)
+    nhog = atoi(argv[1]);
+  if(argc > 2)
+    nsample = atoi(argv[2]);
+  if(nhog < 0 || nhog > NPROC-4 || nsample <= 0 || nsample > MAXSAMPLE){
+    fprintf(2, "usage: latbench [nhog [nsample]]\n");
+    exit(1);
+  }
+
+  if(pipe(to) < 0 || pipe(from) < 0){
+    fprintf(2, "latbench: pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "latbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(to[1]);
+    close(from[0]);
+    while(read(to[0], &c, 1) == 1)
+      write(from[1], &c, 1);
+    exit(0);
+  }
+  close(to[0]);
+  close(from[1]);
+
+  for(i = 0; i < nhog; i++){
+    if((hogs[i] = fork()) < 0){
+      fprintf(2, "latbench: fork failed\n");
+      exit(1);
+    }
+    if(hogs[i] == 0){
+      volatile int x = 0;
+      for(;;)
+        x++;
+    }
+  }
+
+  measure("hogs at default priority", nsample, to[1], from[0]);
+
+  for(i = 0; i < nhog; i++)
+    setpriority(hogs[i], NPRIO-1);
+  measure("hogs at lowest priority", nsample, to[1], from[0]);
+
+  for(i = 0; i < nhog; i++){
+    kill(hogs[i]);
+    wait(0);
+  }
+  close(to[1]);
+  wait(0);
+  exit(0);
+}
@@ -0,0 +1,96 @@
+// Print spinlock contention statistics.
+//
+// With no arguments, prints the totals since boot for the
+// most contended lock names. With a command, runs it and
+// prints what happened to the locks while it ran.
+//
+// usage: lockstat [command [arg ...]]
+
+#include "kernel/types.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define MAXSTAT 80
+#define NSHOW 12
+
+struct lockstat before[MAXSTAT], after[MAXSTAT];
+
+// Print s padded with spaces to width w.
+void
+pad(char *s, int w)
+{
+  int n = strlen(s);
+
+  printf("%s", s);
+  while(n++ < w)
+    printf(" ");
+}
+
+void
+show(struct lockstat *st, int n)
+{
+  int i;
+
+  printf("name             locks   acquires   contended   spins\n");
+  for(i = 0; i < n && i < NSHOW; i++){
+    if(st[i].nacquire == 0)
+      break;
+    pad(st[i].name, 17);
+    printf("%d\t%l\t%l\t%l\n", st[i].nlock, st[i].nacquire,
+           st[i].ncontend, st[i].nspin);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat t;
+  int nb, na, i, j, pid;
+
+  if(argc < 2){
+    if((na = lockstat(after, MAXSTAT)) < 0){
+      fprintf(2, "lockstat: lockstat failed\n");
+      exit(1);
+    }
+    show(after, na);
+    exit(0);
+  }
+
+  nb = lockstat(before, MAXSTAT);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "lockstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  na = lockstat(after, MAXSTAT);
+  if(nb < 0 || na < 0){
+    fprintf(2, "lockstat: lockstat failed\n");
+    exit(1);
+  }
+
+  // subtract the counts from before, by name.
+  for(i = 0; i < na; i++){
+    for(j = 0; j < nb; j++){
+      if(strcmp(after[i].name, before[j].name) == 0){
+        after[i].nacquire -= before[j].nacquire;
+        after[i].ncontend -= before[j].ncontend;
+        after[i].nspin -= before[j].nspin;
+        break;
+      }
+    }
+  }
+  for(i = 1; i < na; i++){
+    t = after[i];
+    for(j = i; j > 0 && after[j-1].ncontend < t.ncontend; j--)
+      after[j] = after[j-1];
+    after[j] = t;
+  }
+  show(after, na);
+  exit(0);
+}
@@ -0,0 +1,102 @@
+// Path lookup benchmark.
+//
+// Runs 1, 2, 4, ... processes that each open, fstat and close
+// their own file under one shared directory prefix, over and
+// over, and reports the total rate. Every lookup walks the
+// same directories, which the dcache lets namex() do without
+// locking them.
+//
+// usage: namebench [maxprocs [ms]]
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char *dirs[] = { "nbench", "nbench/a", "nbench/a/b", "nbench/a/b/c" };
+#define NDIR (sizeof(dirs)/sizeof(dirs[0]))
+
+void
+path(char *buf, int i)
+{
+  strcpy(buf, "/nbench/a/b/c/f0");
+  buf[strlen(buf)-1] = '0' + i;
+}
+
+void
+looker(int i, uint64 end)
+{
+  char name[32];
+  struct stat st;
+  int fd, n;
+
+  path(name, i);
+  for(n = 0; nsnow() < end; n++){
+    if((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+      fprintf(2, "namebench: open %s failed\n", name);
+      exit(-1);
+    }
+    close(fd);
+  }
+  exit(n);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxprocs = 4, ms = 2000;
+  int n, i, fd, total, x;
+  uint64 end;
+  char name[32];
+
+  if(argc > 1)
+    maxprocs = atoi(argv[1]);
+  if(argc > 2)
+    ms = atoi(argv[2]);
+  // init, sh and namebench itself need procs too.
+  if(maxprocs < 1 || maxprocs > NPROC-3 || ms < 1){
+    fprintf(2, "usage: namebench [maxprocs [ms]]\n");
+    exit(1);
+  }
+
+  for(i = 0; i < NDIR; i++)
+    mkdir(dirs[i]);
+  for(i = 0; i < maxprocs; i++){
+    path(name, i);
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+      fprintf(2, "namebench: create %s failed\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  for(n = 1; n <= maxprocs; n *= 2){
+    end = nsnow() + (uint64)ms * 1000000;
+    for(i = 0; i < n; i++){
+      int pid = fork();
+      if(pid < 0){
+        fprintf(2, "namebench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0)
+        looker(i, end);
+    }
+    total = 0;
+    for(i = 0; i < n; i++){
+      wait(&x);
+      if(x < 0)
+        exit(1);
+      total += x;
+    }
+    printf("%d procs: %d lookups/sec\n", n, (int)((uint64)total * 1000 / ms));
+  }
+
+  for(i = 0; i < maxprocs; i++){
+    path(name, i);
+    unlink(name);
+  }
+  for(i = NDIR; i > 0; i--)
+    unlink(dirs[i-1]);
+  exit(0);
+}
@@ -0,0 +1,92 @@
+// open()/close() throughput benchmark.
+//
+// nproc processes each open and close a file, and a pipe, as
+// fast as they can, while holding nfd other descriptors open,
+// so that each one's table has grown past its first NOFILE
+// slots. Reports the total rate for 1, 2, ... nproc processes;
+// on a multi-hart machine they run on different harts, and the
+// rate should grow with them, since descriptors and struct
+// files are allocated without a shared lock.
+//
+// usage: openbench [nproc [nfd]]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NOPS 2000
+
+// Open and close NOPS times; exit 1 if anything failed.
+void
+worker(int nfd)
+{
+  int i, fd, p[2];
+
+  for(i = 0; i < nfd; i++){
+    if(dup(0) < 0){
+      fprintf(2, "openbench: dup failed\n");
+      exit(1);
+    }
+  }
+  for(i = 0; i < NOPS; i++){
+    if((fd = open("openbench.data", O_RDONLY)) < 0)
+      exit(1);
+    close(fd);
+    if(pipe(p) < 0)
+      exit(1);
+    close(p[0]);
+    close(p[1]);
+  }
+  exit(0);
+}
+
+void
+run(int nproc, int nfd)
+{
+  int i, xstatus, failed = 0;
+  uint64 start, ns;
+
+  start = nsnow();
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0)
+      worker(nfd);
+  }
+  for(i = 0; i < nproc; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      failed = 1;
+  }
+  ns = nsnow() - start;
+  if(failed){
+    fprintf(2, "openbench: a worker failed\n");
+    exit(1);
+  }
+  // each op is an open() and a close(), of a file and of a pipe.
+  printf("%d procs: %d opens/s\n", nproc,
+         (int)((uint64)nproc * NOPS * 2 * 1000000000 / (ns + 1)));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc = 3, nfd = 32;
+  int i, fd;
+
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    nfd = atoi(argv[2]);
+  if(nproc < 1 || nfd < 0){
+    fprintf(2, "usage: openbench [nproc [nfd]]\n");
+    exit(1);
+  }
+  if((fd = open("openbench.data", O_CREATE|O_WRONLY)) < 0){
+    fprintf(2, "openbench: create failed\n");
+    exit(1);
+  }
+  close(fd);
+  for(i = 1; i <= nproc; i++)
+    run(i, nfd);
+  unlink("openbench.data");
+  exit(0);
+}
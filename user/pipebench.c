@@ -0,0 +1,157 @@
+// Pipe throughput benchmark.
+//
+// A writer sends messages of several sizes through a pipe to
+// a child that reads and counts them, and reports the rate for
+// each size, and for 4 KB messages through pipes of several
+// capacities, set with fcntl(F_SETPIPE_SZ). Then it moves a
+// file into the pipe with read()/write() and with splice(),
+// which hands the pipe the file's cached pages instead of
+// copying them. Rates come from nsnow(), so they're only as
+// good as qemu's time CSR.
+//
+// usage: pipebench [kbytes]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define MAXMSG 16384
+
+char buf[MAXMSG];
+int sizes[] = { 64, 512, 4096, 16384 };
+int caps[] = { 4096, 16384, 65536 };
+
+// Start a child that drains the read end of p, and exits with
+// status 0 if it read exactly total bytes.
+void
+drain(int *p, int total)
+{
+  int n, tot = 0;
+
+  if(fork() == 0){
+    close(p[1]);
+    while((n = read(p[0], buf, sizeof(buf))) > 0)
+      tot += n;
+    exit(tot == total ? 0 : 1);
+  }
+  close(p[0]);
+}
+
+// Wait for the drain child; report the rate since start.
+void
+finish(char *what, int size, int total, uint64 start)
+{
+  int xstatus, rate;
+
+  wait(&xstatus);
+  rate = (uint64)total / 1024 * 1000000000 / (nsnow() - start + 1);
+  if(xstatus != 0){
+    fprintf(2, "pipebench: reader got the wrong amount\n");
+    exit(1);
+  }
+  if(size)
+    printf("%s %d bytes: %d KB/s\n", what, size, rate);
+  else
+    printf("%s: %d KB/s\n", what, rate);
+}
+
+// Send total bytes in messages of size bytes through a pipe
+// of capacity cap, or the default capacity if cap is 0.
+void
+messages(int size, int total, int cap)
+{
+  int p[2], i;
+  uint64 start;
+
+  // small messages take long; send fewer of them.
+  if(total / size > 4096)
+    total = size * 4096;
+  if(pipe(p) < 0){
+    fprintf(2, "pipebench: pipe failed\n");
+    exit(1);
+  }
+  if(cap && fcntl(p[1], F_SETPIPE_SZ, cap) != cap){
+    fprintf(2, "pipebench: F_SETPIPE_SZ failed\n");
+    exit(1);
+  }
+  drain(p, total);
+  start = nsnow();
+  for(i = 0; i < total; i += size){
+    if(write(p[1], buf, size) != size){
+      fprintf(2, "pipebench: write failed\n");
+      exit(1);
+    }
+  }
+  close(p[1]);
+  if(cap)
+    printf("capacity %d, ", cap);
+  finish("write", size, total, start);
+}
+
+void
+fromfile(int total, int usesplice)
+{
+  int p[2], fd, n;
+  uint64 start;
+
+  if(pipe(p) < 0 || (fd = open("pipebench.data", O_RDONLY)) < 0){
+    fprintf(2, "pipebench: setup failed\n");
+    exit(1);
+  }
+  drain(p, total);
+  start = nsnow();
+  if(usesplice){
+    while((n = splice(fd, p[1], total)) > 0)
+      ;
+  } else {
+    while((n = read(fd, buf, 4096)) > 0)
+      if(write(p[1], buf, n) != n)
+        n = -1;
+  }
+  if(n < 0){
+    fprintf(2, "pipebench: copy failed\n");
+    exit(1);
+  }
+  close(p[1]);
+  close(fd);
+  finish(usesplice ? "file to pipe, splice" : "file to pipe, read/write",
+         0, total, start);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kbytes = 1024;
+  int i, fd, total;
+
+  if(argc > 1)
+    kbytes = atoi(argv[1]);
+  if(kbytes < 16){
+    fprintf(2, "usage: pipebench [kbytes]\n");
+    exit(1);
+  }
+  kbytes &= ~15;
+  total = kbytes * 1024;
+
+  memset(buf, 'p', sizeof(buf));
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    messages(sizes[i], total, 0);
+  for(i = 0; i < sizeof(caps)/sizeof(caps[0]); i++)
+    messages(4096, total, caps[i]);
+
+  if((fd = open("pipebench.data", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "pipebench: create failed\n");
+    exit(1);
+  }
+  for(i = 0; i < total; i += MAXMSG){
+    if(write(fd, buf, MAXMSG) != MAXMSG){
+      fprintf(2, "pipebench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+  fromfile(total, 0);
+  fromfile(total, 1);
+  unlink("pipebench.data");
+  exit(0);
+}
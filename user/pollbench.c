@@ -0,0 +1,131 @@
+// poll() relay benchmark.
+//
+// A relay process waits on NIN input pipes with poll() and
+// copies each byte that arrives on any of them to an output
+// pipe. The benchmark leaves the relay idle for a while, then
+// sends bytes round-robin over the inputs and waits for each
+// to come back. Reports how many times the relay polled, and
+// the fastest, mean and slowest round trip, each timed with
+// nsnow(). It does the same with a relay that
+// busy-polls, with a zero timeout, for comparison: a blocking
+// relay polls about once per byte and not at all while idle.
+//
+// usage: pollbench [nping [idleticks]]
+
+#include "kernel/types.h"
+#include "kernel/poll.h"
+#include "user/user.h"
+
+#define NIN 4
+
+int in[NIN][2];
+int out[2];
+
+// Relay bytes from in[] to out until a 'q' arrives; then write
+// the number of poll() calls to out and exit.
+void
+relay(int busy)
+{
+  struct pollfd fds[NIN];
+  int i, npoll = 0;
+  char c;
+
+  for(i = 0; i < NIN; i++){
+    close(in[i][1]);
+    fds[i].fd = in[i][0];
+    fds[i].events = POLLIN;
+  }
+  close(out[0]);
+  for(;;){
+    npoll++;
+    if(poll(fds, NIN, busy ? 0 : -1) < 0){
+      fprintf(2, "pollbench: poll failed\n");
+      exit(1);
+    }
+    for(i = 0; i < NIN; i++){
+      if((fds[i].revents & POLLIN) == 0)
+        continue;
+      if(read(fds[i].fd, &c, 1) != 1)
+        exit(1);
+      if(c == 'q'){
+        write(out[1], &npoll, sizeof(npoll));
+        exit(0);
+      }
+      write(out[1], &c, 1);
+    }
+  }
+}
+
+void
+run(int busy, int nping, int idle)
+{
+  int i, npoll;
+  uint64 t, ns, sum, min, max;
+  char c, r;
+
+  for(i = 0; i < NIN; i++){
+    if(pipe(in[i]) < 0){
+      fprintf(2, "pollbench: pipe failed\n");
+      exit(1);
+    }
+  }
+  if(pipe(out) < 0){
+    fprintf(2, "pollbench: pipe failed\n");
+    exit(1);
+  }
+  if(fork() == 0)
+    relay(busy);
+  for(i = 0; i < NIN; i++)
+    close(in[i][0]);
+  close(out[1]);
+
+  sleep(idle);
+  sum = max = 0;
+  min = ~0ULL;
+  for(i = 0; i < nping; i++){
+    c = 'a' + i % 26;
+    t = nsnow();
+    if(write(in[i % NIN][1], &c, 1) != 1 || read(out[0], &r, 1) != 1 || r != c){
+      fprintf(2, "pollbench: relay lost a byte\n");
+      exit(1);
+    }
+    ns = nsnow() - t;
+    sum += ns;
+    if(ns < min)
+      min = ns;
+    if(ns > max)
+      max = ns;
+  }
+  write(in[0][1], "q", 1);
+  if(read(out[0], &npoll, sizeof(npoll)) != sizeof(npoll)){
+    fprintf(2, "pollbench: relay failed\n");
+    exit(1);
+  }
+  wait(0);
+  for(i = 0; i < NIN; i++)
+    close(in[i][1]);
+  close(out[0]);
+
+  printf("%s: %d polls for %d bytes and %d idle ticks\n",
+         busy ? "busy poll" : "blocking poll", npoll, nping + 1, idle);
+  printf("  round trip: min %d us, mean %d us, max %d us\n",
+         (int)(min / 1000), (int)(sum / 1000 / nping), (int)(max / 1000));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nping = 1000, idle = 10;
+
+  if(argc > 1)
+    nping = atoi(argv[1]);
+  if(argc > 2)
+    idle = atoi(argv[2]);
+  if(nping < 1 || idle < 0){
+    fprintf(2, "usage: pollbench [nping [idleticks]]\n");
+    exit(1);
+  }
+  run(0, nping, idle);
+  run(1, nping, idle);
+  exit(0);
+}
@@ -1,19 +1,65 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/uio.h"
 #include "user/user.h"
 
 #include <stdarg.h>
 
 static char digits[] = "0123456789ABCDEF";
 
+// vprintf() gathers its output as pieces: runs of the format
+// and %s strings where they are, and other characters copied
+// into buf. It writes them all with one writev(), unless
+// there are too many for that.
+struct out {
+  int fd;
+  int n;                    // pieces in iov
+  int nbuf;                 // bytes used in buf
+  struct iovec iov[IOVMAX];
+  char buf[128];
+};
+
+static void
+flush(struct out *o)
+{
+  if(o->n > 0)
+    writev(o->fd, o->iov, o->n);
+  o->n = 0;
+  o->nbuf = 0;
+}
+
+static void
+putn(struct out *o, const char *s, int n)
+{
+  struct iovec *last;
+
+  if(o->n > 0){
+    last = &o->iov[o->n - 1];
+    if((char*)last->iov_base + last->iov_len == s){
+      last->iov_len += n;
+      return;
+    }
+  }
+  if(o->n == IOVMAX)
+    flush(o);
+  o->iov[o->n].iov_base = (void*)s;
+  o->iov[o->n].iov_len = n;
+  o->n++;
+}
+
 static void
-putc(int fd, char c)
+putc(struct out *o, char c)
 {
-  write(fd, &c, 1);
+  // flush first if need be, so that buf isn't reused
+  // while a piece still points into it.
+  if(o->nbuf == sizeof(o->buf) || o->n == IOVMAX)
+    flush(o);
+  o->buf[o->nbuf] = c;
+  putn(o, &o->buf[o->nbuf++], 1);
 }
 
 static void
-printint(int fd, int xx, int base, int sgn)
+printint(struct out *o, int xx, int base, int sgn)
 {
   char buf[16];
   int i, neg;
@@ -35,16 +81,16 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while(--i >= 0)
-    putc(fd, buf[i]);
+    putc(o, buf[i]);
 }
 
 static void
-printptr(int fd, uint64 x) {
+printptr(struct out *o, uint64 x) {
   int i;
-  putc(fd, '0');
-  putc(fd, 'x');
+  putc(o, '0');
+  putc(o, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    putc(fd, digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(o, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the given fd. Only understands %d, %x, %p, %s.
@@ -53,7 +99,10 @@ vprintf(int fd, const char *fmt, va_list ap)
 {
   char *s;
   int c, i, state;
+  struct out o;
 
+  o.fd = fd;
+  o.n = o.nbuf = 0;
   state = 0;
   for(i = 0; fmt[i]; i++){
     c = fmt[i] & 0xff;
@@ -61,37 +110,36 @@ vprintf(int fd, const char *fmt, va_list ap)
       if(c == '%'){
         state = '%';
       } else {
-        putc(fd, c);
+        putn(&o, &fmt[i], 1);
       }
     } else if(state == '%'){
       if(c == 'd'){
-        printint(fd, va_arg(ap, int), 10, 1);
+        printint(&o, va_arg(ap, int), 10, 1);
       } else if(c == 'l') {
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(&o, va_arg(ap, uint64), 10, 0);
       } else if(c == 'x') {
-        printint(fd, va_arg(ap, int), 16, 0);
+        printint(&o, va_arg(ap, int), 16, 0);
       } else if(c == 'p') {
-        printptr(fd, va_arg(ap, uint64));
+        printptr(&o, va_arg(ap, uint64));
       } else if(c == 's'){
         s = va_arg(ap, char*);
         if(s == 0)
           s = "(null)";
-        while(*s != 0){
-          putc(fd, *s);
-          s++;
-        }
+        if(*s != 0)
+          putn(&o, s, strlen(s));
       } else if(c == 'c'){
-        putc(fd, va_arg(ap, uint));
+        putc(&o, va_arg(ap, uint));
       } else if(c == '%'){
-        putc(fd, c);
+        putc(&o, c);
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c);
+        putc(&o, '%');
+        putc(&o, c);
       }
       state = 0;
     }
   }
+  flush(&o);
 }
 
 void
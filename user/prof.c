@@ -0,0 +1,305 @@
+// Sampling profiler.
+//
+// Runs a command with the kernel's profiler on, and prints a
+// flat profile: for each function, in the kernel or in a user
+// program, the share of samples that found a cpu in it. The
+// build puts the symbol tables in the file system: kernel.sym
+// for the kernel and, for a program such as bigfile,
+// bigfile.sym. A thread drains the kernel's sample rings while
+// the command runs.
+//
+// usage: prof [-r rate] [-n lines] command [args...]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define NPC 4096          // distinct pcs counted
+#define NFN 1024          // distinct functions reported
+#define NTAB 32           // symbol tables loaded
+
+// the samples at one pc of one program, or of the kernel.
+struct pccount {
+  uint64 pc;
+  char prog[16];          // "" for the kernel
+  int n;
+};
+
+struct sym {
+  uint64 addr;
+  char *name;
+};
+
+struct symtab {
+  char prog[16];
+  struct sym *sym;        // sorted by addr
+  int n;
+};
+
+struct fncount {
+  struct symtab *tab;
+  struct sym *sym;        // 0 if pc is below every symbol
+  int n;
+};
+
+struct pccount pcs[NPC];
+struct fncount fns[NFN];
+struct symtab tabs[NTAB];
+int ntab, nfn;
+int nsample, nuser, nother;
+struct profsample buf[256];
+volatile int done;
+
+// Count buf[0..n-1] in pcs[], a hash table.
+void
+count(int n)
+{
+  struct profsample *s;
+  struct pccount *c;
+  char *prog;
+  int i, h, k;
+
+  for(i = 0; i < n; i++){
+    s = &buf[i];
+    prog = s->user ? s->name : "";
+    nsample++;
+    if(s->user)
+      nuser++;
+    h = (s->pc >> 1) % NPC;
+    for(k = 0; k < NPC; k++){
+      c = &pcs[(h + k) % NPC];
+      if(c->n == 0){
+        c->pc = s->pc;
+        strcpy(c->prog, prog);
+      }
+      if(c->pc == s->pc && strcmp(c->prog, prog) == 0){
+        c->n++;
+        break;
+      }
+    }
+    if(k == NPC)
+      nother++;
+  }
+}
+
+// The thread that drains the kernel's sample rings.
+void
+drain(void *arg)
+{
+  int n;
+
+  for(;;){
+    while((n = profread(buf, sizeof(buf)/sizeof(buf[0]))) > 0)
+      count(n);
+    if(done)
+      break;
+    sleep(1);
+  }
+}
+
+int
+ishex(char c)
+{
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+}
+
+// Is name a function or variable, rather than a section
+// (".text") or source file ("ulib.c")?
+int
+isfunc(char *name)
+{
+  int n = strlen(name);
+
+  if(name[0] == '.' || name[0] == 0)
+    return 0;
+  return n < 2 || name[n-2] != '.';
+}
+
+// Read prog's symbol table, from lines of "address name" as
+// the build writes them. Returns 0 if there isn't one.
+struct symtab*
+loadsyms(char *prog)
+{
+  struct symtab *t;
+  struct stat st;
+  char file[32], *p, *q, *text;
+  int fd, i, j, n;
+  struct sym s;
+
+  for(t = tabs; t < &tabs[ntab]; t++)
+    if(strcmp(t->prog, prog) == 0)
+      return t->n ? t : 0;
+  if(ntab == NTAB)
+    return 0;
+  t = &tabs[ntab++];
+  strcpy(t->prog, prog);
+  t->n = 0;
+
+  if(strlen(prog) + 5 > sizeof(file))
+    return 0;
+  strcpy(file, prog[0] ? prog : "kernel");
+  strcpy(file + strlen(file), ".sym");
+  if((fd = open(file, O_RDONLY)) < 0)
+    return 0;
+  if(fstat(fd, &st) < 0 || (text = malloc(st.size + 1)) == 0){
+    close(fd);
+    return 0;
+  }
+  n = read(fd, text, st.size);
+  close(fd);
+  if(n != st.size)
+    return 0;
+  text[n] = 0;
+
+  // at most one symbol per line.
+  for(i = 0, p = text; *p; p++)
+    if(*p == '\n')
+      i++;
+  if((t->sym = malloc(i * sizeof(struct sym))) == 0)
+    return 0;
+  for(p = text; *p; p = q + 1){
+    if((q = strchr(p, '\n')) == 0)
+      break;
+    *q = 0;
+    s.addr = 0;
+    for(; ishex(*p); p++)
+      s.addr = s.addr * 16 + (*p <= '9' ? *p - '0' : *p - 'a' + 10);
+    if(*p != ' ' || !isfunc(p + 1))
+      continue;
+    s.name = p + 1;
+    // insertion sort.
+    for(j = t->n++; j > 0 && t->sym[j-1].addr > s.addr; j--)
+      t->sym[j] = t->sym[j-1];
+    t->sym[j] = s;
+  }
+  return t->n ? t : 0;
+}
+
+// The symbol at or below pc in t, or 0.
+struct sym*
+lookup(struct symtab *t, uint64 pc)
+{
+  int lo = 0, hi = t->n, mid;
+
+  // find the first symbol above pc.
+  while(lo < hi){
+    mid = (lo + hi) / 2;
+    if(t->sym[mid].addr <= pc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo > 0 ? &t->sym[lo-1] : 0;
+}
+
+// Add the samples at pc c to the count for its function.
+void
+addfn(struct pccount *c)
+{
+  struct symtab *t;
+  struct sym *s;
+  int i;
+
+  t = loadsyms(c->prog);
+  s = t ? lookup(t, c->pc) : 0;
+  if(s == 0){
+    nother += c->n;
+    return;
+  }
+  for(i = 0; i < nfn; i++){
+    if(fns[i].tab == t && fns[i].sym == s){
+      fns[i].n += c->n;
+      return;
+    }
+  }
+  if(nfn == NFN){
+    nother += c->n;
+    return;
+  }
+  fns[nfn].tab = t;
+  fns[nfn].sym = s;
+  fns[nfn].n = c->n;
+  nfn++;
+}
+
+void
+report(int lines, int lost)
+{
+  struct fncount f;
+  int i, j, pct;
+
+  for(i = 0; i < NPC; i++)
+    if(pcs[i].n)
+      addfn(&pcs[i]);
+  for(i = 1; i < nfn; i++){
+    f = fns[i];
+    for(j = i; j > 0 && fns[j-1].n < f.n; j--)
+      fns[j] = fns[j-1];
+    fns[j] = f;
+  }
+
+  printf("%d samples, %d in user code, %d lost, %d not symbolized\n",
+         nsample, nuser, lost, nother);
+  if(nsample == 0)
+    return;
+  printf("samples\t%%\tfunction\n");
+  for(i = 0; i < nfn && i < lines; i++){
+    pct = fns[i].n * 1000 / nsample;
+    printf("%d\t%d.%d\t%s:%s\n", fns[i].n, pct / 10, pct % 10,
+           fns[i].tab->prog[0] ? fns[i].tab->prog : "kernel", fns[i].sym->name);
+  }
+}
+
+void
+usage(void)
+{
+  fprintf(2, "usage: prof [-r rate] [-n lines] command [args...]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rate = PROFRATE, lines = 20;
+  int i, pid, lost;
+
+  for(i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2){
+    if(strcmp(argv[i], "-r") == 0)
+      rate = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-n") == 0)
+      lines = atoi(argv[i+1]);
+    else
+      usage();
+  }
+  if(i >= argc || lines < 1)
+    usage();
+
+  if(profstart(rate) < 0){
+    fprintf(2, "prof: can't start at rate %d; is prof already running?\n", rate);
+    exit(1);
+  }
+  if(thread_create(drain, 0) < 0){
+    fprintf(2, "prof: thread_create failed\n");
+    profstop();
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "prof: fork failed\n");
+    profstop();
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[i], argv + i);
+    fprintf(2, "prof: exec %s failed\n", argv[i]);
+    exit(1);
+  }
+  wait(0);
+  lost = profstop();
+  done = 1;
+  thread_join();
+  report(lines, lost);
+  exit(0);
+}
@@ -0,0 +1,109 @@
+// Parallel sum benchmark for clone() threads.
+//
+// Sums an array of NELEM ints with 1, 2, 4, ... threads, each
+// adding up its own slice, and reports how long each takes.
+// The calling thread sums a slice too, so n threads need n-1
+// clone()s. The fs lab's NPROC of 10 leaves room for 8 with
+// init and sh; run with CPUS=8 to see it scale that far.
+//
+// usage: psum [maxthreads [rounds]]
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define NELEM (4*1024*1024)
+#define MAXTHREAD 8
+
+// one cache line per thread, so that their sums don't share one.
+struct work {
+  int *a;
+  int n;
+  int rounds;
+  uint64 sum;
+  char pad[40];
+} work[MAXTHREAD];
+
+void
+sum(void *arg)
+{
+  struct work *w = arg;
+  uint64 s = 0;
+  int i, r;
+
+  for(r = 0; r < w->rounds; r++)
+    for(i = 0; i < w->n; i++)
+      s += w->a[i];
+  w->sum = s;
+}
+
+// Sum a[] rounds times with nthread threads.
+// Returns the number of ticks taken.
+int
+run(int *a, int nthread, int rounds)
+{
+  int i, start;
+  uint64 total;
+
+  for(i = 0; i < nthread; i++){
+    work[i].a = a + (uint64)NELEM * i / nthread;
+    work[i].n = NELEM * (uint64)(i+1) / nthread - NELEM * (uint64)i / nthread;
+    work[i].rounds = rounds;
+    work[i].sum = 0;
+  }
+
+  start = uptime();
+  for(i = 1; i < nthread; i++){
+    if(thread_create(sum, &work[i]) < 0){
+      fprintf(2, "psum: clone failed\n");
+      exit(1);
+    }
+  }
+  sum(&work[0]);
+  for(i = 1; i < nthread; i++)
+    thread_join();
+
+  total = 0;
+  for(i = 0; i < nthread; i++)
+    total += work[i].sum;
+  if(total != (uint64)NELEM * (NELEM - 1) / 2 * rounds){
+    fprintf(2, "psum: wrong sum with %d threads\n", nthread);
+    exit(1);
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxthread = MAXTHREAD, rounds = 20;
+  int n, i, ticks, base = 0;
+  int *a;
+
+  if(argc > 1)
+    maxthread = atoi(argv[1]);
+  if(argc > 2)
+    rounds = atoi(argv[2]);
+  if(maxthread <= 0 || maxthread > MAXTHREAD || rounds <= 0){
+    fprintf(2, "usage: psum [maxthreads [rounds]]\n");
+    exit(1);
+  }
+
+  if((a = malloc(NELEM * sizeof(int))) == 0){
+    fprintf(2, "psum: out of memory\n");
+    exit(1);
+  }
+  for(i = 0; i < NELEM; i++)
+    a[i] = i;
+
+  for(n = 1; n <= maxthread; n *= 2){
+    ticks = run(a, n, rounds);
+    if(n == 1)
+      base = ticks;
+    if(ticks > 0)
+      printf("%d threads: %d ticks, speedup %d.%d\n", n, ticks,
+             base / ticks, base * 10 / ticks % 10);
+    else
+      printf("%d threads: %d ticks\n", n, ticks);
+  }
+  exit(0);
+}
@@ -0,0 +1,212 @@
+// Ring I/O benchmark.
+//
+// Copies a file with read() and write(), and then again with
+// ringsetup()/ringenter(), keeping NRBUF chunks in flight:
+// reads run ahead in parallel on the ring workers while the
+// chunks already read are written out. Writes are issued one
+// at a time, in order, since xv6 files can't have holes.
+// Reports the copy rate and the number of system calls.
+//
+// usage: ringbench [kbytes [nworker]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/ring.h"
+#include "user/user.h"
+
+#define CHUNK 4096
+#define NRBUF 8
+
+char buf[NRBUF][CHUNK];
+int bufoff[NRBUF];        // file offset of the chunk in buf[i]
+int buflen[NRBUF];        // bytes read into it; -1 while reading
+struct ring *r;
+int pending;              // sqes not yet passed to ringenter()
+int nsyscall;
+
+void
+opencopy(int *src, int *dst)
+{
+  if((*src = open("ringbench.src", O_RDONLY)) < 0 ||
+     (*dst = open("ringbench.dst", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "ringbench: open failed\n");
+    exit(1);
+  }
+}
+
+void
+plaincopy(void)
+{
+  int src, dst, n;
+
+  opencopy(&src, &dst);
+  for(;;){
+    n = read(src, buf[0], CHUNK);
+    nsyscall++;
+    if(n <= 0)
+      break;
+    if(write(dst, buf[0], n) != n){
+      fprintf(2, "ringbench: write failed\n");
+      exit(1);
+    }
+    nsyscall++;
+  }
+  close(src);
+  close(dst);
+}
+
+void
+submit(int op, int fd, int i, int n, int off)
+{
+  struct sqe *e = &r->sq[r->sqtail % RINGSIZE];
+
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint64)buf[i];
+  e->n = n;
+  e->off = off;
+  e->data = i;
+  __atomic_store_n(&r->sqtail, r->sqtail + 1, __ATOMIC_RELEASE);
+  pending++;
+}
+
+void
+ringcopy(int size)
+{
+  int src, dst, i, n, next, wnext, writing, inflight;
+  struct cqe c;
+
+  opencopy(&src, &dst);
+  next = wnext = 0;
+  inflight = 0;
+  writing = -1;           // buffer being written, if any
+  for(i = 0; i < NRBUF && next < size; i++){
+    bufoff[i] = next;
+    buflen[i] = -1;
+    submit(RING_READ, src, i, CHUNK, next);
+    next += CHUNK;
+    inflight++;
+  }
+
+  while(inflight > 0){
+    if((n = ringenter(pending, 1)) < 0){
+      fprintf(2, "ringbench: ringenter failed\n");
+      exit(1);
+    }
+    pending -= n;
+    nsyscall++;
+    while(r->cqhead != __atomic_load_n(&r->cqtail, __ATOMIC_ACQUIRE)){
+      c = r->cq[r->cqhead % RINGSIZE];
+      __atomic_store_n(&r->cqhead, r->cqhead + 1, __ATOMIC_RELEASE);
+      inflight--;
+      i = c.data;
+      if(c.res < 0){
+        fprintf(2, "ringbench: ring i/o failed\n");
+        exit(1);
+      }
+      if(i == writing){
+        // written; read the next chunk into it.
+        writing = -1;
+        wnext += buflen[i];
+        if(next < size){
+          bufoff[i] = next;
+          buflen[i] = -1;
+          submit(RING_READ, src, i, CHUNK, next);
+          next += CHUNK;
+          inflight++;
+        }
+      } else {
+        buflen[i] = c.res;
+      }
+    }
+    // write out the next chunk in order, if it has been read.
+    for(i = 0; writing < 0 && i < NRBUF; i++){
+      if(bufoff[i] == wnext && buflen[i] > 0 && wnext < size){
+        submit(RING_WRITE, dst, i, buflen[i], wnext);
+        writing = i;
+        inflight++;
+      }
+    }
+  }
+  close(src);
+  close(dst);
+}
+
+// Check that ringbench.dst is a copy of ringbench.src.
+void
+check(int size)
+{
+  int src, dst, n, total = 0;
+
+  src = open("ringbench.src", O_RDONLY);
+  dst = open("ringbench.dst", O_RDONLY);
+  while((n = read(src, buf[0], CHUNK)) > 0){
+    if(read(dst, buf[1], CHUNK) != n || memcmp(buf[0], buf[1], n) != 0)
+      break;
+    total += n;
+  }
+  if(total != size || read(dst, buf[1], CHUNK) != 0){
+    fprintf(2, "ringbench: copy differs\n");
+    exit(1);
+  }
+  close(src);
+  close(dst);
+}
+
+void
+report(char *what, int kbytes, uint64 ns)
+{
+  printf("%s: %d KB/s, %d syscalls\n", what,
+         (int)((uint64)kbytes * 1000000000 / (ns + 1)), nsyscall);
+  nsyscall = 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kbytes = 256, nworker = 2;
+  int i, fd, size;
+  uint64 start;
+
+  if(argc > 1)
+    kbytes = atoi(argv[1]);
+  if(argc > 2)
+    nworker = atoi(argv[2]);
+  if(kbytes < 1 || nworker < 1){
+    fprintf(2, "usage: ringbench [kbytes [nworker]]\n");
+    exit(1);
+  }
+  size = kbytes * 1024;
+
+  if((fd = open("ringbench.src", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "ringbench: create failed\n");
+    exit(1);
+  }
+  for(i = 0; i < kbytes; i++){
+    memset(buf[0], 'a' + i % 26, 1024);
+    if(write(fd, buf[0], 1024) != 1024){
+      fprintf(2, "ringbench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  start = nsnow();
+  plaincopy();
+  report("read/write", kbytes, nsnow() - start);
+  check(size);
+
+  if((r = ringsetup(nworker)) == (struct ring*)-1){
+    fprintf(2, "ringbench: ringsetup failed\n");
+    exit(1);
+  }
+  start = nsnow();
+  ringcopy(size);
+  report("ring", kbytes, nsnow() - start);
+  check(size);
+
+  unlink("ringbench.src");
+  unlink("ringbench.dst");
+  exit(0);
+}
@@ -0,0 +1,146 @@
+// Scheduler benchmark.
+//
+// Runs npair pairs of processes that bounce a byte back and
+// forth over two pipes, so that every hop puts one process to
+// sleep and wakes the other. Reports context switches per
+// second across all pairs, and, from one pair on its own, the
+// mean time from the write() that wakes a process to its
+// read() returning, timed with nsnow() on both sides.
+//
+// The number of harts is fixed when qemu boots, so to see how
+// the scheduler scales, run it under make CPUS=1, 2, 4 and 8
+// qemu in turn.
+//
+// usage: schedbench [npair [ms]]
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+// what each pair reports to run().
+struct result {
+  int trips;
+  uint64 wakens;          // total wakeup-to-run ns, one per trip
+  uint64 ns;              // how long run() took, set by run()
+};
+
+// Bounce a byte between two processes until the deadline,
+// then write the result to fd.
+void
+pingpong(uint64 end, int fd)
+{
+  int ab[2], ba[2];
+  int pid;
+  uint64 t;
+  struct result r;
+  char c = 0;
+
+  if(pipe(ab) < 0 || pipe(ba) < 0){
+    fprintf(2, "schedbench: pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "schedbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    // echo back the time just before each write.
+    close(fd);
+    close(ab[1]);
+    close(ba[0]);
+    while(read(ab[0], &c, 1) == 1){
+      t = nsnow();
+      write(ba[1], &t, sizeof(t));
+    }
+    exit(0);
+  }
+
+  close(ab[0]);
+  close(ba[1]);
+  r.trips = 0;
+  r.wakens = 0;
+  while(nsnow() < end){
+    if(write(ab[1], &c, 1) != 1 || read(ba[0], &t, sizeof(t)) != sizeof(t)){
+      fprintf(2, "schedbench: pipe broke\n");
+      exit(1);
+    }
+    r.wakens += nsnow() - t;
+    r.trips++;
+  }
+  close(ab[1]);
+  wait(0);
+  write(fd, &r, sizeof(r));
+  exit(0);
+}
+
+// Run npair ping-pong pairs for ms milliseconds.
+// Returns their results added up.
+struct result
+run(int npair, int ms)
+{
+  int i, st, fds[2];
+  uint64 start, end;
+  struct result r, total;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "schedbench: pipe failed\n");
+    exit(1);
+  }
+  start = nsnow();
+  end = start + (uint64)ms * 1000000;
+  for(i = 0; i < npair; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "schedbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      pingpong(end, fds[1]);
+    }
+  }
+  close(fds[1]);
+
+  total.trips = 0;
+  total.wakens = 0;
+  for(i = 0; i < npair; i++){
+    wait(&st);
+    if(st != 0 || read(fds[0], &r, sizeof(r)) != sizeof(r)){
+      fprintf(2, "schedbench: a pair failed\n");
+      exit(1);
+    }
+    total.trips += r.trips;
+    total.wakens += r.wakens;
+  }
+  close(fds[0]);
+  total.ns = nsnow() - start;
+  return total;
+}
+
+int
+main(int argc, char *argv[])
+{
+  // the fs lab's NPROC is 10, which leaves room for 2 pairs.
+  int npair = 2, ms = 2000;
+  struct result r;
+
+  if(argc > 1)
+    npair = atoi(argv[1]);
+  if(argc > 2)
+    ms = atoi(argv[2]);
+  if(npair <= 0 || ms <= 0){
+    fprintf(2, "usage: schedbench [npair [ms]]\n");
+    exit(1);
+  }
+
+  // two wakeups, and two switches in and out, per round trip.
+  r = run(npair, ms);
+  printf("%d pairs: %d switches/sec\n", npair,
+         (int)((uint64)r.trips * 2 * 1000000000 / r.ns));
+
+  r = run(1, ms);
+  if(r.trips > 0)
+    printf("1 pair: %d ns from wakeup to run\n",
+           (int)(r.wakens / r.trips));
+  exit(0);
+}
@@ -0,0 +1,130 @@
+// sendfile() benchmark.
+//
+// Copies a file to another file, and into a pipe that a child
+// drains, first with read() and write() through a user buffer
+// and then with sendfile(), which moves the data inside the
+// kernel. Reports the rate of each.
+//
+// usage: sendbench [kbytes]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char buf[4096];
+
+void
+copy(int dst, int src, int usesend)
+{
+  int n;
+
+  if(usesend){
+    while((n = sendfile(dst, src, 1 << 20)) > 0)
+      ;
+  } else {
+    while((n = read(src, buf, sizeof(buf))) > 0)
+      if(write(dst, buf, n) != n)
+        n = -1;
+  }
+  if(n < 0){
+    fprintf(2, "sendbench: copy failed\n");
+    exit(1);
+  }
+}
+
+void
+report(char *what, int kbytes, uint64 ns)
+{
+  printf("%s: %d KB/s\n", what, (int)((uint64)kbytes * 1000000000 / (ns + 1)));
+}
+
+// Copy sendbench.data to sendbench.copy.
+void
+tofile(int kbytes, int usesend)
+{
+  int src, dst;
+  uint64 start;
+
+  src = open("sendbench.data", O_RDONLY);
+  if((dst = open("sendbench.copy", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "sendbench: create failed\n");
+    exit(1);
+  }
+  start = nsnow();
+  copy(dst, src, usesend);
+  report(usesend ? "file to file, sendfile" : "file to file, read/write",
+         kbytes, nsnow() - start);
+  close(src);
+  close(dst);
+}
+
+// Copy sendbench.data into a pipe, and check that a child
+// reads all of it out.
+void
+topipe(int kbytes, int usesend)
+{
+  int src, fds[2], n, tot, xstatus;
+  uint64 start;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "sendbench: pipe failed\n");
+    exit(1);
+  }
+  if(fork() == 0){
+    close(fds[1]);
+    tot = 0;
+    while((n = read(fds[0], buf, sizeof(buf))) > 0)
+      tot += n;
+    exit(tot == kbytes * 1024 ? 0 : 1);
+  }
+  close(fds[0]);
+  src = open("sendbench.data", O_RDONLY);
+  start = nsnow();
+  copy(fds[1], src, usesend);
+  close(fds[1]);
+  wait(&xstatus);
+  report(usesend ? "file to pipe, sendfile" : "file to pipe, read/write",
+         kbytes, nsnow() - start);
+  close(src);
+  if(xstatus != 0){
+    fprintf(2, "sendbench: pipe reader got the wrong amount\n");
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kbytes = 2048;
+  int i, fd;
+
+  if(argc > 1)
+    kbytes = atoi(argv[1]);
+  if(kbytes < 4){
+    fprintf(2, "usage: sendbench [kbytes]\n");
+    exit(1);
+  }
+  kbytes &= ~3;
+
+  if((fd = open("sendbench.data", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "sendbench: create failed\n");
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < kbytes / 4; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "sendbench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  tofile(kbytes, 0);
+  tofile(kbytes, 1);
+  topipe(kbytes, 0);
+  topipe(kbytes, 1);
+
+  unlink("sendbench.data");
+  unlink("sendbench.copy");
+  exit(0);
+}
@@ -3,6 +3,8 @@
 #include "kernel/types.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/clock.h"
+#include "kernel/rusage.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,6 +54,7 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void timecmd(char*);
 
 // Execute cmd.  Never returns.
 void
@@ -164,6 +167,10 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
+    if(buf[0] == 't' && buf[1] == 'i' && buf[2] == 'm' && buf[3] == 'e' && buf[4] == ' '){
+      timecmd(buf+5);
+      continue;
+    }
     if(fork1() == 0)
       runcmd(parsecmd(buf));
     wait(0);
@@ -171,6 +178,28 @@ main(void)
   exit(0);
 }
 
+// Run cmd, and then report the time and other resources it used.
+void
+timecmd(char *cmd)
+{
+  struct timespec t0, t1;
+  struct rusage ru;
+  uint64 ms;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if(fork1() == 0)
+    runcmd(parsecmd(cmd));
+  if(wait2(0, &ru) < 0)
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  ms = (t1.sec - t0.sec) * 1000 + t1.nsec / 1000000 - t0.nsec / 1000000;
+  fprintf(2, "%d ms real, %d ms user, %d ms sys\n",
+          (int)ms, (int)(ru.utime / 1000), (int)(ru.stime / 1000));
+  fprintf(2, "%d faults, %d blocks in, %d blocks out, %d pages, %d+%d switches\n",
+          (int)ru.nfault, (int)ru.inblock, (int)ru.oublock, (int)ru.npages,
+          (int)ru.nvcsw, (int)ru.nivcsw);
+}
+
 void
 panic(char *s)
 {
@@ -0,0 +1,70 @@
+// Deferred-commit benchmark.
+//
+// Creates, writes, closes and deletes nfile temporary files,
+// as a compiler or a mail queue might: first with a log commit
+// at the end of every system call, then with commits deferred
+// by commitdelay(), and then deferred but with an fsync() of
+// each file before it's closed. Reports the rate of each, and
+// the disk writes and log commits it took.
+//
+// usage: syncbench [nfile]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define DELAY 30          // ticks, for commitdelay()
+
+char buf[1024];
+
+void
+run(char *what, int nfile, int delay, int dofsync)
+{
+  struct fsstat st0, st1;
+  int i, fd;
+  uint64 start, ns;
+
+  commitdelay(delay);
+  fsstat(&st0);
+  start = nsnow();
+  for(i = 0; i < nfile; i++){
+    if((fd = open("syncbench.tmp", O_CREATE|O_TRUNC|O_WRONLY)) < 0 ||
+       write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "syncbench: write failed\n");
+      exit(1);
+    }
+    if(dofsync && fsync(fd) < 0){
+      fprintf(2, "syncbench: fsync failed\n");
+      exit(1);
+    }
+    close(fd);
+    unlink("syncbench.tmp");
+  }
+  ns = nsnow() - start;
+  fsstat(&st1);
+  printf("%s: %d files/s, %d disk writes, %d commits\n", what,
+         (int)((uint64)nfile * 1000000000 / (ns + 1)),
+         (int)(st1.nwrite - st0.nwrite), (int)(st1.ncommit - st0.ncommit));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nfile = 200, old;
+
+  if(argc > 1)
+    nfile = atoi(argv[1]);
+  if(nfile < 1){
+    fprintf(2, "usage: syncbench [nfile]\n");
+    exit(1);
+  }
+  memset(buf, 's', sizeof(buf));
+
+  old = commitdelay(-1);
+  run("commit per call", nfile, 0, 0);
+  run("deferred", nfile, DELAY, 0);
+  run("deferred, fsync", nfile, DELAY, 1);
+  commitdelay(old);
+  exit(0);
+}
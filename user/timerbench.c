@@ -0,0 +1,46 @@
+// sleep() accuracy benchmark.
+//
+// Calls sleep(n) repeatedly for a few values of n and compares
+// the total time that passed, by nsnow(), with the time asked
+// for. A sleep that wakes at the next tick boundary instead of
+// n whole ticks later shows up as a shortfall.
+//
+// To see timer wakeups on an idle system, type ^P (which prints
+// per-cpu timer interrupt counts), wait, and type ^P again.
+//
+// usage: timerbench [rounds]
+
+#include "kernel/types.h"
+#include "kernel/clock.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int ns[] = { 1, 2, 5, 10 };
+  int rounds = 10;
+  struct clockpage *cp = clockpage();
+  int i, j, start;
+  uint64 t0, want;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds <= 0){
+    fprintf(2, "usage: timerbench [rounds]\n");
+    exit(1);
+  }
+
+  for(i = 0; i < sizeof(ns)/sizeof(ns[0]); i++){
+    // start just after a tick.
+    start = uptime();
+    while(uptime() == start)
+      ;
+    t0 = nsnow();
+    for(j = 0; j < rounds; j++)
+      sleep(ns[i]);
+    want = (uint64)ns[i] * rounds * cp->tickcycles * 1000000 / cp->hz;
+    printf("sleep(%d) x %d: %d us, asked for %d us\n",
+           ns[i], rounds, (int)((nsnow() - t0) / 1000), (int)want);
+  }
+  exit(0);
+}
@@ -1,6 +1,10 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/clock.h"
 #include "user/user.h"
 
 char*
@@ -134,3 +138,134 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+#define THREADSTACK 16384
+
+static void
+threadstart(void *fn, void *arg)
+{
+  ((void (*)(void*))fn)(arg);
+  exit(0);
+}
+
+// Start a thread running fn(arg) on a stack from malloc().
+// malloc() isn't thread-safe, so only one thread of a
+// process should create and join threads.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  char *stack;
+  int tid;
+
+  if((stack = malloc(THREADSTACK)) == 0)
+    return -1;
+  if((tid = clone(threadstart, fn, arg, stack, THREADSTACK)) < 0)
+    free(stack);
+  return tid;
+}
+
+// Wait for a thread started by thread_create() to return,
+// free its stack, and return its pid.
+int
+thread_join(void)
+{
+  void *stack;
+  int tid;
+
+  if((tid = join(&stack)) >= 0)
+    free(stack);
+  return tid;
+}
+
+// A mutex that only enters the kernel when contended: a
+// locker that finds it held marks it 2, "has waiters", and
+// sleeps in futex_wait(); unlock only calls futex_wake()
+// if it was 2.
+void
+mutex_lock(struct mutex *m)
+{
+  int c = 0;
+
+  if(__atomic_compare_exchange_n(&m->v, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  if(c != 2)
+    c = __atomic_exchange_n(&m->v, 2, __ATOMIC_ACQUIRE);
+  while(c != 0){
+    futex_wait(&m->v, 2);
+    c = __atomic_exchange_n(&m->v, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__atomic_exchange_n(&m->v, 0, __ATOMIC_RELEASE) == 2)
+    futex_wake(&m->v, 1);
+}
+
+// Wait for cond_signal() or cond_broadcast(), releasing m
+// meanwhile. As usual, the caller must recheck its condition.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, 0x7fffffff);
+}
+
+// Cycles since boot, from the time CSR; no system call.
+uint64
+rdtime(void)
+{
+  return r_time();
+}
+
+// The kernel's clock page for this process.
+struct clockpage*
+clockpage(void)
+{
+  return (struct clockpage*)CLOCKPAGE;
+}
+
+// Time since boot, to the resolution of the time CSR,
+// without a system call.
+int
+clock_gettime(int clk, struct timespec *ts)
+{
+  struct clockpage *cp = clockpage();
+  uint64 t;
+
+  if(clk != CLOCK_MONOTONIC)
+    return -1;
+  t = rdtime();
+  ts->sec = t / cp->hz;
+  ts->nsec = ((t % cp->hz) * cp->nsmult) >> cp->nsshift;
+  return 0;
+}
+
+// Nanoseconds since boot, as clock_gettime() reads them,
+// for timing things.
+uint64
+nsnow(void)
+{
+  struct clockpage *cp = clockpage();
+  uint64 t = rdtime();
+
+  return t / cp->hz * 1000000000 + (((t % cp->hz) * cp->nsmult) >> cp->nsshift);
+}
@@ -1,5 +1,22 @@
 struct stat;
 struct rtcdate;
+struct lockstat;
+struct ring;
+struct iovec;
+struct pollfd;
+struct fsstat;
+struct clockpage;
+struct timespec;
+struct rusage;
+struct profsample;
+
+// ulib.c's locks; zero-initialized ones are ready to use.
+struct mutex {
+  int v;        // 0 unlocked, 1 locked, 2 locked with waiters
+};
+struct cond {
+  int seq;      // bumped by every signal
+};
 
 // system calls
 int fork(void);
@@ -25,6 +42,34 @@ int sleep(int);
 int uptime(void);
 // 添加
 int symlink(char *target,char *path);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int setpriority(int, int);
+int clone(void (*)(void*, void*), void*, void*, void*, int);
+int join(void**);
+int futex_wait(int*, int);
+int futex_wake(int*, int);
+int lockstat(struct lockstat*, int);
+struct ring* ringsetup(int);
+int ringenter(int, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int sendfile(int, int, int);
+int splice(int, int, int);
+int fcntl(int, int, int);
+int poll(struct pollfd*, int, int);
+int fsync(int);
+int fdatasync(int);
+int sync(void);
+int commitdelay(int);
+int fsstat(struct fsstat*);
+int getrusage(int, struct rusage*);
+int wait2(int*, struct rusage*);
+int profstart(int);
+int profstop(void);
+int profread(struct profsample*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -42,3 +87,14 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+int thread_create(void (*)(void*), void*);
+int thread_join(void);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+uint64 rdtime(void);
+struct clockpage* clockpage(void);
+int clock_gettime(int, struct timespec*);
+uint64 nsnow(void);
@@ -7,6 +7,12 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/ring.h"
+#include "kernel/uio.h"
+#include "kernel/poll.h"
+#include "kernel/clock.h"
+#include "kernel/rusage.h"
+#include "kernel/prof.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -2462,6 +2468,886 @@ stacktest(char *s)
     exit(xstatus);
 }
 
+// check that writes to the text segment fault, since
+// exec() maps text read-only and shares it between processes.
+void
+textwrite(char *s)
+{
+  int pid;
+  int xstatus;
+  
+  pid = fork();
+  if(pid == 0) {
+    volatile int *addr = (int *) 0;
+    *addr = 10;
+    exit(1);
+  } else if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus == -1)  // kernel killed child?
+    exit(0);
+  else
+    exit(xstatus);
+}
+
+// anonymous mmap() with 2MB megapages: fork must copy
+// them, munmap() of a 4K page must split one and leave the
+// rest of it alone, and munmap() must free them.
+void
+hugemmap(char *s)
+{
+  int pid, xstatus, i;
+  char *p;
+  int len = 2*MEGAPGSIZE;
+
+  p = mmap(0, len, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE|MAP_HUGE, -1, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  if((uint64)p % MEGAPGSIZE){
+    printf("%s: mmap not aligned\n", s);
+    exit(1);
+  }
+  for(i = 0; i < len; i += PGSIZE){
+    if(p[i] != 0){
+      printf("%s: mmap not zeroed\n", s);
+      exit(1);
+    }
+    p[i] = i / PGSIZE;
+  }
+  if(sbrk(0) >= p){
+    printf("%s: mmap overlaps heap\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < len; i += PGSIZE){
+      if(p[i] != (char)(i / PGSIZE))
+        exit(1);
+      p[i] = 'x';
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong content\n", s);
+    exit(1);
+  }
+  for(i = 0; i < len; i += PGSIZE){
+    if(p[i] != (char)(i / PGSIZE)){
+      printf("%s: child's write leaked into parent\n", s);
+      exit(1);
+    }
+  }
+
+  if(munmap(p + PGSIZE, MEGAPGSIZE) == 0){
+    printf("%s: munmap of the middle of a region succeeded\n", s);
+    exit(1);
+  }
+  if(munmap(p, PGSIZE) < 0 || munmap(p + len - PGSIZE, PGSIZE) < 0){
+    printf("%s: munmap of a 4K page failed\n", s);
+    exit(1);
+  }
+  for(i = PGSIZE; i < len - PGSIZE; i += PGSIZE){
+    if(p[i] != (char)(i / PGSIZE)){
+      printf("%s: split megapage lost its content\n", s);
+      exit(1);
+    }
+  }
+  if(munmap(p + PGSIZE, len - 2*PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid == 0){
+    p[0] = 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: access after munmap didn't fault\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// file mmap(): MAP_SHARED stores are seen at once by read()
+// and by a forked child, and reach the file on munmap();
+// MAP_PRIVATE stores are not, and write() is seen only
+// through MAP_SHARED.
+void
+mmapfile(char *s)
+{
+  int fd, pid, xstatus, i;
+  char *p, *q, c;
+  char *name = "mmapfile.tmp";
+  int len = 2*PGSIZE + 100;
+
+  unlink(name);
+  fd = open(name, O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < len; i++)
+    if(write(fd, "a", 1) != 1){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+
+  p = mmap(0, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  q = mmap(0, len, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1 || q == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  if(p[0] != 'a' || p[len-1] != 'a' || p[len] != 0 || q[PGSIZE] != 'a'){
+    printf("%s: mapped wrong content\n", s);
+    exit(1);
+  }
+  q[PGSIZE] = 'q';
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    p[PGSIZE] = 'b';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || p[PGSIZE] != 'b'){
+    printf("%s: child's MAP_SHARED store not seen\n", s);
+    exit(1);
+  }
+  if(pread(fd, &c, 1, PGSIZE) != 1 || c != 'b'){
+    printf("%s: read() doesn't see a MAP_SHARED store\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "d", 1, PGSIZE+1) != 1 || p[PGSIZE+1] != 'd' || q[PGSIZE+1] != 'a'){
+    printf("%s: write() not seen through MAP_SHARED only\n", s);
+    exit(1);
+  }
+  p[len-1] = 'c';
+  if(munmap(p, len) < 0 || munmap(q, len) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open(name, O_RDONLY);
+  for(i = 0; i < len; i++){
+    char want = 'a';
+    if(i == PGSIZE)
+      want = 'b';
+    if(i == PGSIZE+1)
+      want = 'd';
+    if(i == len-1)
+      want = 'c';
+    if(read(fd, &c, 1) != 1 || c != want){
+      printf("%s: file has wrong content at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  fd = open(name, O_RDONLY);
+  if(mmap(0, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != (char*)-1){
+    printf("%s: writable MAP_SHARED of a read-only fd\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink(name);
+  exit(0);
+}
+
+// threads share memory and file descriptors, join() returns
+// their stacks, wait() ignores them, and exit() of the first
+// thread takes the others with it.
+int tcount[4];
+int tfd;
+
+void
+threadinc(void *a0, void *a1)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++)
+    tcount[(uint64)a0]++;
+  if((uint64)a0 == 0)
+    tfd = open("threadsfile", O_CREATE|O_RDWR);
+  exit(0);
+}
+
+void
+threadspin(void *a0, void *a1)
+{
+  for(;;)
+    ;
+}
+
+void
+threads(char *s)
+{
+  char *stacks[4];
+  void *stack;
+  int i, n, pid, xstatus;
+
+  tfd = -1;
+  for(i = 0; i < 4; i++){
+    stacks[i] = malloc(4096);
+    if(clone(threadinc, (void*)(uint64)i, 0, stacks[i], 4096) < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  if(wait(0) != -1){
+    printf("%s: wait() returned a thread\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 4; i++){
+    if(join(&stack) < 0){
+      printf("%s: join failed\n", s);
+      exit(1);
+    }
+    for(n = 0; n < 4 && stacks[n] != stack; n++)
+      ;
+    if(n == 4){
+      printf("%s: join returned a bad stack\n", s);
+      exit(1);
+    }
+  }
+  if(join(&stack) != -1){
+    printf("%s: join with no threads succeeded\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 4; i++){
+    if(tcount[i] != 1000){
+      printf("%s: thread %d's stores went missing\n", s, i);
+      exit(1);
+    }
+  }
+  if(tfd < 0 || write(tfd, "x", 1) != 1){
+    printf("%s: thread's open file isn't shared\n", s);
+    exit(1);
+  }
+  close(tfd);
+  unlink("threadsfile");
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    clone(threadspin, 0, 0, stacks[0], 4096);
+    clone(threadspin, 0, 0, stacks[1], 4096);
+    exit(7);
+  }
+  wait(&xstatus);
+  if(xstatus != 7){
+    printf("%s: exit with threads running failed\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// futex_wait() returns at once if the word has changed,
+// and threads serialize properly on a ulib mutex.
+struct mutex fmutex;
+int fcount;
+
+void
+futexinc(void *arg)
+{
+  int i;
+
+  for(i = 0; i < 10000; i++){
+    mutex_lock(&fmutex);
+    fcount++;
+    mutex_unlock(&fmutex);
+  }
+}
+
+void
+futex(char *s)
+{
+  int word = 1, i;
+
+  if(futex_wait(&word, 2) != -1){
+    printf("%s: futex_wait slept on a changed word\n", s);
+    exit(1);
+  }
+  if(futex_wake(&word, 1) != 0){
+    printf("%s: futex_wake woke someone\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 3; i++){
+    if(thread_create(futexinc, 0) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  futexinc(0);
+  for(i = 0; i < 3; i++)
+    thread_join();
+  if(fcount != 40000){
+    printf("%s: count %d, not 40000\n", s, fcount);
+    exit(1);
+  }
+  exit(0);
+}
+
+// submit one request to ring r and wait for its result.
+int
+ringdo(struct ring *r, int op, int fd, void *addr, int n, int off)
+{
+  struct sqe *e = &r->sq[r->sqtail % RINGSIZE];
+  struct cqe *c;
+
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->n = n;
+  e->off = off;
+  e->data = r->sqtail;
+  __atomic_store_n(&r->sqtail, r->sqtail + 1, __ATOMIC_RELEASE);
+  if(ringenter(1, 1) != 1)
+    return -2;
+  c = &r->cq[r->cqhead % RINGSIZE];
+  if(c->data != r->sqtail - 1)
+    return -2;
+  __atomic_store_n(&r->cqhead, r->cqhead + 1, __ATOMIC_RELEASE);
+  return c->res;
+}
+
+void
+ringio(char *s)
+{
+  struct ring *r;
+  struct stat st;
+  char buf[8];
+  int fd;
+
+  if((r = ringsetup(2)) == (struct ring*)-1){
+    printf("%s: ringsetup failed\n", s);
+    exit(1);
+  }
+  if(ringsetup(1) != (struct ring*)-1){
+    printf("%s: second ringsetup succeeded\n", s);
+    exit(1);
+  }
+  if((fd = ringdo(r, RING_OPEN, 0, "ringio", O_CREATE|O_RDWR, 0)) < 0){
+    printf("%s: RING_OPEN failed\n", s);
+    exit(1);
+  }
+  if(ringdo(r, RING_WRITE, fd, "abcde", 5, -1) != 5 ||
+     ringdo(r, RING_WRITE, fd, "X", 1, 2) != 1){
+    printf("%s: RING_WRITE failed\n", s);
+    exit(1);
+  }
+  if(ringdo(r, RING_FSTAT, fd, &st, 0, 0) != 0 || st.size != 5){
+    printf("%s: RING_FSTAT failed\n", s);
+    exit(1);
+  }
+  if(ringdo(r, RING_READ, fd, buf, sizeof(buf), 0) != 5 || memcmp(buf, "abXde", 5) != 0){
+    printf("%s: RING_READ failed\n", s);
+    exit(1);
+  }
+  if(ringdo(r, RING_CLOSE, fd, 0, 0, 0) != 0 || ringdo(r, RING_CLOSE, fd, 0, 0, 0) != -1){
+    printf("%s: RING_CLOSE failed\n", s);
+    exit(1);
+  }
+  unlink("ringio");
+  exit(0);
+}
+
+// pread, pwrite, readv and writev.
+void
+rwvec(char *s)
+{
+  struct iovec iov[2];
+  char a[3], b[4];
+  int fd;
+
+  if((fd = open("rwvec", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "abc";
+  iov[0].iov_len = 3;
+  iov[1].iov_base = "defg";
+  iov[1].iov_len = 4;
+  if(writev(fd, iov, 2) != 7){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "X", 1, 1) != 1 || pwrite(fd, "X", 1, 100) != -1){
+    printf("%s: pwrite wrong\n", s);
+    exit(1);
+  }
+  if(pread(fd, b, 4, 3) != 4 || memcmp(b, "defg", 4) != 0){
+    printf("%s: pread wrong\n", s);
+    exit(1);
+  }
+  // pread and pwrite leave the offset at the end of the writev.
+  if(read(fd, b, 1) != 0){
+    printf("%s: offset moved\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("rwvec", O_RDONLY);
+  iov[0].iov_base = a;
+  iov[0].iov_len = 3;
+  iov[1].iov_base = b;
+  iov[1].iov_len = 4;
+  if(readv(fd, iov, 2) != 7 || memcmp(a, "aXc", 3) != 0 || memcmp(b, "defg", 4) != 0){
+    printf("%s: readv wrong\n", s);
+    exit(1);
+  }
+  if(readv(fd, iov, IOVMAX+1) != -1){
+    printf("%s: readv took too many buffers\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("rwvec");
+  exit(0);
+}
+
+// sendfile() from a file to a file and to a pipe.
+void
+sendfiletest(char *s)
+{
+  int src, dst, fds[2];
+  char buf[16];
+
+  src = open("sendsrc", O_CREATE|O_RDWR);
+  dst = open("senddst", O_CREATE|O_RDWR);
+  if(src < 0 || dst < 0 || write(src, "0123456789", 10) != 10){
+    printf("%s: setup failed\n", s);
+    exit(1);
+  }
+  if(sendfile(dst, src, 5) != 0 || sendfile(dst, dst, 5) != -1){
+    printf("%s: sendfile at EOF or to itself moved data\n", s);
+    exit(1);
+  }
+  close(src);
+  src = open("sendsrc", O_RDONLY);
+  if(sendfile(dst, src, 4) != 4 || sendfile(dst, src, 100) != 6 ||
+     pread(dst, buf, sizeof(buf), 0) != 10 || memcmp(buf, "0123456789", 10) != 0){
+    printf("%s: file to file wrong\n", s);
+    exit(1);
+  }
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  close(dst);
+  dst = open("senddst", O_RDONLY);
+  if(sendfile(fds[1], dst, 3) != 3 || read(fds[0], buf, sizeof(buf)) != 3 ||
+     memcmp(buf, "012", 3) != 0 || sendfile(fds[1], fds[0], 1) != -1){
+    printf("%s: file to pipe wrong\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(src);
+  close(dst);
+  unlink("sendsrc");
+  unlink("senddst");
+  exit(0);
+}
+
+// splice() from a file into a pipe, and from a pipe into a file.
+void
+splicetest(char *s)
+{
+  int fd, fds[2];
+  char buf[8];
+
+  fd = open("splice", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "abcdef", 6) != 6 || pipe(fds) < 0){
+    printf("%s: setup failed\n", s);
+    exit(1);
+  }
+  if(splice(fd, fds[1], 6) != 0 || splice(fds[0], fds[1], 1) != -1){
+    printf("%s: splice at EOF or pipe to pipe moved data\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("splice", O_RDWR);
+  if(splice(fd, fds[1], 4) != 4 || write(fds[1], "XY", 2) != 2){
+    printf("%s: file to pipe failed\n", s);
+    exit(1);
+  }
+  // the spliced page is shared, so the write above must not
+  // have gone into it.
+  if(read(fds[0], buf, 3) != 3 || memcmp(buf, "abc", 3) != 0){
+    printf("%s: file to pipe wrong\n", s);
+    exit(1);
+  }
+  if(splice(fds[0], fd, 100) != 3 || pread(fd, buf, 8, 0) != 7 ||
+     memcmp(buf, "abcddXY", 7) != 0){
+    printf("%s: pipe to file wrong\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(fd);
+  unlink("splice");
+  exit(0);
+}
+
+// fcntl(F_SETPIPE_SZ) limits how much a pipe holds.
+void
+pipesize(char *s)
+{
+  int fds[2], pid, xstatus, n, tot;
+  static char pbuf[3*4096+5];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[0], F_GETPIPE_SZ, 0) != 16*4096 ||
+     fcntl(fds[1], F_SETPIPE_SZ, 100) != 4096 ||
+     fcntl(fds[0], F_GETPIPE_SZ, 0) != 4096 ||
+     fcntl(fds[1], F_SETPIPE_SZ, 17*4096) != -1){
+    printf("%s: F_GETPIPE_SZ/F_SETPIPE_SZ wrong\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    memset(pbuf, 'q', sizeof(pbuf));
+    if(write(fds[1], pbuf, sizeof(pbuf)) != sizeof(pbuf))
+      exit(1);
+    exit(0);
+  }
+  close(fds[1]);
+  // the writer can't get ahead by more than a page.
+  sleep(1);
+  tot = read(fds[0], pbuf, sizeof(pbuf));
+  if(tot <= 0 || tot > 4096){
+    printf("%s: pipe held more than its capacity\n", s);
+    exit(1);
+  }
+  while((n = read(fds[0], pbuf, sizeof(pbuf))) > 0)
+    tot += n;
+  wait(&xstatus);
+  if(xstatus != 0 || tot != sizeof(pbuf)){
+    printf("%s: lost data\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  exit(0);
+}
+
+// poll() on pipes, and O_NONBLOCK.
+void
+polltest(char *s)
+{
+  int p[2], q[2], pid, xstatus;
+  struct pollfd fds[3];
+  char c;
+
+  if(pipe(p) < 0 || pipe(q) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  fds[0].fd = p[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = q[0];
+  fds[1].events = POLLIN;
+  fds[2].fd = p[1];
+  fds[2].events = POLLOUT;
+  if(poll(fds, 2, 0) != 0 || poll(fds, 2, 2) != 0 ||
+     poll(fds, 3, -1) != 1 || fds[2].revents != POLLOUT){
+    printf("%s: empty pipes polled ready\n", s);
+    exit(1);
+  }
+  if(fcntl(p[0], F_SETFL, O_NONBLOCK) != 0 ||
+     fcntl(p[0], F_GETFL, 0) != (O_RDONLY|O_NONBLOCK) || read(p[0], &c, 1) != -1){
+    printf("%s: O_NONBLOCK read of an empty pipe didn't fail\n", s);
+    exit(1);
+  }
+
+  // a blocked poll() wakes when a byte arrives.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(2);
+    write(q[1], "x", 1);
+    exit(0);
+  }
+  if(poll(fds, 2, -1) != 1 || fds[0].revents != 0 || fds[1].revents != POLLIN ||
+     read(q[0], &c, 1) != 1 || c != 'x'){
+    printf("%s: poll() didn't see the write\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+
+  close(p[1]);
+  if(poll(fds, 1, -1) != 1 || fds[0].revents != POLLHUP || read(p[0], &c, 1) != 0){
+    printf("%s: no POLLHUP after close\n", s);
+    exit(1);
+  }
+  close(p[0]);
+  close(q[0]);
+  close(q[1]);
+  exit(xstatus);
+}
+
+// fsync() and sync() with commits deferred by commitdelay().
+void
+fsynctest(char *s)
+{
+  int fd, fds[2], old;
+  struct fsstat st0, st1;
+  char buf[8];
+
+  old = commitdelay(1000);
+  if(commitdelay(-1) != 1000){
+    printf("%s: commitdelay didn't take\n", s);
+    exit(1);
+  }
+  fd = open("fsync", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "durable", 7) != 7){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  fsstat(&st0);
+  if(fsync(fd) != 0){
+    printf("%s: fsync failed\n", s);
+    exit(1);
+  }
+  fsstat(&st1);
+  if(st1.ncommit != st0.ncommit + 1){
+    printf("%s: fsync didn't commit\n", s);
+    exit(1);
+  }
+  // nothing new to commit.
+  if(fdatasync(fd) != 0 || sync() != 0){
+    printf("%s: fdatasync or sync failed\n", s);
+    exit(1);
+  }
+  fsstat(&st0);
+  if(st0.ncommit != st1.ncommit){
+    printf("%s: fdatasync committed again\n", s);
+    exit(1);
+  }
+  if(pread(fd, buf, 7, 0) != 7 || memcmp(buf, "durable", 7) != 0){
+    printf("%s: read back wrong\n", s);
+    exit(1);
+  }
+  if(pipe(fds) < 0 || fsync(fds[0]) != -1){
+    printf("%s: fsync of a pipe didn't fail\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(fd);
+  unlink("fsync");
+  commitdelay(old);
+  exit(0);
+}
+
+// more descriptors than a new process's table holds, and the
+// lowest free one is reused; a child inherits the grown table.
+void
+manyfds(char *s)
+{
+  enum { N = 100 };
+  int fd, i, pid, xstatus;
+
+  for(i = 3; i < N; i++){
+    if((fd = dup(0)) != i){
+      printf("%s: dup gave %d, not %d\n", s, fd, i);
+      exit(1);
+    }
+  }
+  close(40);
+  close(20);
+  if(dup(0) != 20 || dup(0) != 40){
+    printf("%s: lowest free fd not reused\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(close(N-1) != 0 || dup(0) != N-1)
+      exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child's table is wrong\n", s);
+    exit(1);
+  }
+  for(i = 3; i < N; i++)
+    close(i);
+  exit(0);
+}
+
+// the clock page: clock_gettime() agrees with uptime(), the
+// counters move, and the page can't be written.
+void
+clocktest(char *s)
+{
+  struct clockpage *cp = clockpage();
+  struct timespec t0, t1;
+  uint64 n, ns0, ns1;
+  int pid, xstatus, up;
+
+  up = uptime();
+  if(clock_gettime(CLOCK_MONOTONIC, &t0) != 0 || t0.nsec >= 1000000000){
+    printf("%s: clock_gettime failed\n", s);
+    exit(1);
+  }
+  ns0 = t0.sec * 1000000000 + t0.nsec;
+  if(ns0 / 1000 / (cp->tickcycles * 1000000 / cp->hz) < up){
+    printf("%s: clock_gettime is behind uptime()\n", s);
+    exit(1);
+  }
+  sleep(2);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  ns1 = t1.sec * 1000000000 + t1.nsec;
+  if(ns1 - ns0 < cp->tickcycles * 1000000000 / cp->hz){
+    printf("%s: sleep(2) took less than a tick\n", s);
+    exit(1);
+  }
+
+  n = cp->nsyscall;
+  getpid();
+  getpid();
+  if(cp->nsyscall != n + 2){
+    printf("%s: nsyscall went from %d to %d\n", s, (int)n, (int)cp->nsyscall);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    cp->hz = 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: wrote the clock page\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// getrusage() and wait2() see a child's cpu time, switches,
+// disk writes, and page allocations.
+void
+rusagetest(char *s)
+{
+  struct rusage ru, self, kids;
+  int pid, fd, xstatus, start, i;
+  volatile int spin = 0;
+  char *a;
+
+  getrusage(RUSAGE_SELF, &self);
+  sleep(1);
+  getrusage(RUSAGE_SELF, &ru);
+  if(ru.nvcsw <= self.nvcsw){
+    printf("%s: sleep() wasn't a voluntary switch\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    start = uptime();
+    while(uptime() < start + 3)
+      spin++;
+    if((a = sbrk(4*4096)) == (char*)-1)
+      exit(1);
+    for(i = 0; i < 4; i++)
+      a[i*4096] = 1;
+    fd = open("rusage", O_CREATE|O_WRONLY);
+    if(fd < 0 || write(fd, "x", 1) != 1)
+      exit(1);
+    close(fd);
+    exit(0);
+  }
+  if(wait2(&xstatus, &ru) != pid || xstatus != 0){
+    printf("%s: wait2 failed\n", s);
+    exit(1);
+  }
+  unlink("rusage");
+  if(ru.utime + ru.stime < 100000 || ru.oublock == 0 || ru.npages < 4){
+    printf("%s: child's usage is too low: %d us, %d blocks, %d pages\n", s,
+           (int)(ru.utime + ru.stime), (int)ru.oublock, (int)ru.npages);
+    exit(1);
+  }
+  if(getrusage(RUSAGE_CHILDREN, &kids) != 0 || kids.npages < ru.npages ||
+     getrusage(2, &kids) != -1){
+    printf("%s: RUSAGE_CHILDREN is wrong\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// the profiler samples a process that spins in user space.
+void
+proftest(char *s)
+{
+  struct profsample buf[64];
+  int i, n, mine = 0, start;
+  volatile int spin = 0;
+
+  if(profstart(0) != -1){
+    printf("%s: profstart(0) didn't fail\n", s);
+    exit(1);
+  }
+  // under prof, leave its samples alone.
+  if(profstart(PROFRATE) != 0)
+    exit(0);
+  start = uptime();
+  while(uptime() < start + 3)
+    spin++;
+  profstop();
+  while((n = profread(buf, 64)) > 0)
+    for(i = 0; i < n; i++)
+      if(buf[i].pid == getpid() && buf[i].user)
+        mine++;
+  if(n < 0 || mine == 0){
+    printf("%s: no user samples of this process\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
 // regression test. copyin(), copyout(), and copyinstr() used to cast
 // the virtual page address to uint, which (with certain wild system
 // call arguments) resulted in a kernel page faults.
@@ -2777,6 +3663,22 @@ main(int argc, char *argv[])
     {sbrkarg, "sbrkarg"},
     {validatetest, "validatetest"},
     {stacktest, "stacktest"},
+    {textwrite, "textwrite"},
+    {hugemmap, "hugemmap"},
+    {mmapfile, "mmapfile"},
+    {threads, "threads"},
+    {futex, "futex"},
+    {ringio, "ringio"},
+    {rwvec, "rwvec"},
+    {sendfiletest, "sendfile"},
+    {splicetest, "splice"},
+    {pipesize, "pipesize"},
+    {polltest, "poll"},
+    {fsynctest, "fsync"},
+    {manyfds, "manyfds"},
+    {clocktest, "clock"},
+    {rusagetest, "rusage"},
+    {proftest, "prof"},
     {opentest, "opentest"},
     {writetest, "writetest"},
     {writebig, "writebig"},
@@ -38,3 +38,31 @@ entry("sleep");
 entry("uptime");
 # 添加
 entry("symlink");
+entry("mmap");
+entry("munmap");
+entry("setpriority");
+entry("clone");
+entry("join");
+entry("futex_wait");
+entry("futex_wake");
+entry("lockstat");
+entry("ringsetup");
+entry("ringenter");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");
+entry("sendfile");
+entry("splice");
+entry("fcntl");
+entry("poll");
+entry("fsync");
+entry("fdatasync");
+entry("sync");
+entry("commitdelay");
+entry("fsstat");
+entry("getrusage");
+entry("wait2");
+entry("profstart");
+entry("profstop");
+entry("profread");